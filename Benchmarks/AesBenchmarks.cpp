@@ -0,0 +1,73 @@
+#include "external/AES.h"
+#include <XephTools/MicroBenchmark.h>
+
+#include <vector>
+
+namespace
+{
+	const unsigned int k_dataSize = 4096;
+
+	std::vector<unsigned char> MakeBytes(size_t count, unsigned char seed)
+	{
+		std::vector<unsigned char> bytes(count);
+		for (size_t i = 0; i < count; ++i)
+			bytes[i] = static_cast<unsigned char>(i * 31 + seed);
+		return bytes;
+	}
+}
+
+XEMicroBenchmark("AES/256 ECB encrypt 4 KiB")
+{
+	AES aes(AESKeyLength::AES_256);
+	const std::vector<unsigned char> data = MakeBytes(k_dataSize, 1);
+	const std::vector<unsigned char> key = MakeBytes(32, 2);
+	state.SetBytesPerIteration(k_dataSize);
+	for (auto _ : state)
+	{
+		unsigned char* out = aes.EncryptECB(data.data(), k_dataSize, key.data());
+		xe::DoNotOptimize(out[0]);
+		delete[] out;
+	}
+}
+
+XEMicroBenchmark("AES/256 CBC encrypt 4 KiB")
+{
+	AES aes(AESKeyLength::AES_256);
+	const std::vector<unsigned char> data = MakeBytes(k_dataSize, 1);
+	const std::vector<unsigned char> key = MakeBytes(32, 2);
+	const std::vector<unsigned char> iv = MakeBytes(16, 3);
+	state.SetBytesPerIteration(k_dataSize);
+	for (auto _ : state)
+	{
+		unsigned char* out = aes.EncryptCBC(data.data(), k_dataSize, key.data(), iv.data());
+		xe::DoNotOptimize(out[0]);
+		delete[] out;
+	}
+}
+
+XEMicroBenchmark("AES/256 CBC decrypt 4 KiB")
+{
+	AES aes(AESKeyLength::AES_256);
+	const std::vector<unsigned char> key = MakeBytes(32, 2);
+	const std::vector<unsigned char> iv = MakeBytes(16, 3);
+	unsigned char* encrypted = aes.EncryptCBC(MakeBytes(k_dataSize, 1).data(), k_dataSize, key.data(), iv.data());
+	state.SetBytesPerIteration(k_dataSize);
+	for (auto _ : state)
+	{
+		unsigned char* out = aes.DecryptCBC(encrypted, k_dataSize, key.data(), iv.data());
+		xe::DoNotOptimize(out[0]);
+		delete[] out;
+	}
+	delete[] encrypted;
+}
+
+XEMicroBenchmark("AES/128 CFB encrypt 4 KiB (vector)")
+{
+	AES aes(AESKeyLength::AES_128);
+	const std::vector<unsigned char> data = MakeBytes(k_dataSize, 1);
+	const std::vector<unsigned char> key = MakeBytes(16, 2);
+	const std::vector<unsigned char> iv = MakeBytes(16, 3);
+	state.SetBytesPerIteration(k_dataSize);
+	for (auto _ : state)
+		xe::DoNotOptimize(aes.EncryptCFB(data, key, iv));
+}
@@ -0,0 +1,89 @@
+#include <XephTools/BinaryReader.h>
+#include <XephTools/BinaryWriter.h>
+#include <XephTools/MicroBenchmark.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const size_t k_valueCount = 4096;
+
+	// Written once per benchmark into the temp directory, then read back in the timed loop
+	std::filesystem::path WriteTestFile(const char* name)
+	{
+		const std::filesystem::path path = std::filesystem::temp_directory_path() / name;
+		xe::BinaryWriter writer(path);
+		for (size_t i = 0; i < k_valueCount; ++i)
+		{
+			writer.WriteValue(static_cast<uint32_t>(i * 2654435761u));
+			writer.WriteValue(static_cast<float>(i) * 0.5f);
+			writer.WriteValue(std::string("entry_") + std::to_string(i));
+		}
+		writer.Close();
+		return path;
+	}
+}
+
+XEMicroBenchmark("BinaryReader/uint32 + float + string x4096")
+{
+	const std::filesystem::path path = WriteTestFile("xe_binaryreader_bench.bin");
+	xe::BinaryReader reader(path);
+	state.SetBytesPerIteration(reader.Size());
+	for (auto _ : state)
+	{
+		reader.Seek(0);
+		for (size_t i = 0; i < k_valueCount; ++i)
+		{
+			xe::DoNotOptimize(reader.GetValue<uint32_t>());
+			xe::DoNotOptimize(reader.GetValue<float>());
+			xe::DoNotOptimize(reader.GetValue<std::string>());
+		}
+	}
+	reader.Close();
+	std::filesystem::remove(path);
+}
+
+XEMicroBenchmark("BinaryReader/string into buffer x4096")
+{
+	const std::filesystem::path path = WriteTestFile("xe_binaryreader_bench_buffer.bin");
+	xe::BinaryReader reader(path);
+	state.SetBytesPerIteration(reader.Size());
+	std::string buffer;
+	for (auto _ : state)
+	{
+		reader.Seek(0);
+		for (size_t i = 0; i < k_valueCount; ++i)
+		{
+			uint32_t id = 0;
+			float value = 0.f;
+			reader.GetValue(id);
+			reader.GetValue(value);
+			reader.GetValue(buffer);
+			xe::DoNotOptimize(buffer);
+		}
+	}
+	reader.Close();
+	std::filesystem::remove(path);
+}
+
+XEMicroBenchmark("BinaryReader/GetSizeValue x4096")
+{
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "xe_binaryreader_bench_size.bin";
+	{
+		xe::BinaryWriter writer(path);
+		for (size_t i = 0; i < k_valueCount; ++i)
+			writer.WriteSizeValue(i * 131);
+	}
+	xe::BinaryReader reader(path);
+	state.SetBytesPerIteration(reader.Size());
+	for (auto _ : state)
+	{
+		reader.Seek(0);
+		for (size_t i = 0; i < k_valueCount; ++i)
+			xe::DoNotOptimize(reader.GetSizeValue());
+	}
+	reader.Close();
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,155 @@
+#include <XephTools/CommandStack.h>
+#include <XephTools/DiffCommand.h>
+#include <XephTools/MicroBenchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	struct SetValue
+	{
+		int* Target;
+		int Old;
+		int New;
+
+		SetValue(int* target, int value)
+			: Target(target), Old(*target), New(value)
+		{
+		}
+
+		void Execute() { *Target = New; }
+		void Revert() { *Target = Old; }
+	};
+
+	struct SetSlider : SetValue
+	{
+		using SetValue::SetValue;
+
+		bool MergeWith(const SetSlider& next)
+		{
+			if (next.Target != Target)
+				return false;
+			New = next.New;
+			return true;
+		}
+	};
+}
+
+XEMicroBenchmark("CommandStack/PushAndExecute typed")
+{
+	xe::CommandStack stack(1024);
+	int value = 0;
+	for (auto _ : state)
+		stack.PushAndExecute<SetValue>(&value, value + 1);
+	xe::DoNotOptimize(value);
+}
+
+XEMicroBenchmark("CommandStack/PushAndExecute lambdas")
+{
+	xe::CommandStack stack(1024);
+	int value = 0;
+	for (auto _ : state)
+	{
+		const int old = value;
+		stack.PushAndExecute([&value, old]() { value = old + 1; }, [&value, old]() { value = old; });
+	}
+	xe::DoNotOptimize(value);
+}
+
+XEMicroBenchmark("CommandStack/PushAndExecute xe::Command")
+{
+	xe::CommandStack stack(1024);
+	int value = 0;
+	for (auto _ : state)
+	{
+		const int old = value;
+		stack.PushAndExecute(xe::Command{ [&value, old]() { value = old + 1; }, [&value, old]() { value = old; } });
+	}
+	xe::DoNotOptimize(value);
+}
+
+XEMicroBenchmark("CommandStack/Undo + Redo 1024")
+{
+	xe::CommandStack stack(1024);
+	int value = 0;
+	for (int i = 0; i < 1024; ++i)
+		stack.PushAndExecute<SetValue>(&value, i);
+	for (auto _ : state)
+	{
+		for (int i = 0; i < 1024; ++i)
+			stack.Undo();
+		for (int i = 0; i < 1024; ++i)
+			stack.Redo();
+	}
+	xe::DoNotOptimize(value);
+}
+
+XEMicroBenchmark("CommandStack/PushAndExecute merged")
+{
+	xe::CommandStack stack(1024);
+	int value = 0;
+	for (auto _ : state)
+		stack.PushAndExecute<SetSlider>(&value, value + 1);
+	xe::DoNotOptimize(value);
+}
+
+// Paints 64 tiles of a 512x512 map per edit
+XEMicroBenchmark("CommandStack/DiffCommand 256KiB paint")
+{
+	xe::CommandStack stack(64);
+	std::vector<uint8_t> tiles(512 * 512, 0);
+	std::vector<uint8_t> before = tiles;
+	uint8_t brush = 0;
+	for (auto _ : state)
+	{
+		++brush;
+		const size_t origin = (brush * 4099u) % (tiles.size() - 8 * 512);
+		for (size_t y = 0; y < 8; ++y)
+			for (size_t x = 0; x < 8; ++x)
+				tiles[origin + y * 512 + x] = brush;
+
+		stack.PushAndExecute<xe::DiffCommand>(tiles.data(), tiles.size(), before.data());
+		before = tiles;
+	}
+	xe::DoNotOptimize(stack.ByteSize());
+}
+
+XEMicroBenchmark("CommandStack/DiffCommand Undo + Redo 64")
+{
+	xe::CommandStack stack(64);
+	std::vector<uint8_t> tiles(512 * 512, 0);
+	for (uint8_t brush = 1; brush <= 64; ++brush)
+	{
+		std::vector<uint8_t> before = tiles;
+		for (size_t x = 0; x < 64; ++x)
+			tiles[(brush * 4099u + x * 512) % tiles.size()] = brush;
+		stack.PushAndExecute<xe::DiffCommand>(tiles.data(), tiles.size(), before.data());
+	}
+	for (auto _ : state)
+	{
+		for (int i = 0; i < 64; ++i)
+			stack.Undo();
+		for (int i = 0; i < 64; ++i)
+			stack.Redo();
+	}
+	xe::DoNotOptimize(tiles[0]);
+}
+
+// One Undo/Redo of a 64 command group, vs 64 of each with the recompute after every one
+XEMicroBenchmark("CommandStack/Undo + Redo transaction of 64")
+{
+	xe::CommandStack stack(128);
+	int values[64] = {};
+	int rebuilds = 0;
+	stack.BeginTransaction();
+	for (int i = 0; i < 64; ++i)
+		stack.PushAndExecute<SetValue>(&values[i], i);
+	stack.EndTransaction([&rebuilds]() { ++rebuilds; });
+	for (auto _ : state)
+	{
+		stack.Undo();
+		stack.Redo();
+	}
+	xe::DoNotOptimize(rebuilds);
+}
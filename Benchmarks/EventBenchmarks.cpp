@@ -0,0 +1,305 @@
+#include <XephTools/ConcurrentEvent.h>
+#include <XephTools/Event.h>
+#include <XephTools/EventBus.h>
+#include <XephTools/EventQueue.h>
+#include <XephTools/MessageQueue.h>
+#include <XephTools/MicroBenchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	int g_total = 0;
+
+	void AddToTotal(int value)
+	{
+		g_total += value;
+	}
+
+	std::atomic<uint64_t> g_heavyTotal = 0;
+
+	// Stands in for a CPU-heavy subscriber. Touches shared state once so it is parallel-safe.
+	void HeavyWork(int value)
+	{
+		uint64_t hash = static_cast<uint64_t>(value);
+		for (int i = 0; i < 2000; ++i)
+			hash = hash * 6364136223846793005ull + 1442695040888963407ull;
+		g_heavyTotal.fetch_add(hash, std::memory_order_relaxed);
+	}
+}
+
+XEMicroBenchmark("Event/Invoke 1 subscriber")
+{
+	xe::Event<int> event;
+	event.Subscribe(AddToTotal);
+	int value = 1;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(value);
+		event.Invoke(value);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("Event/Invoke 64 subscribers")
+{
+	xe::Event<int> event;
+	for (int i = 0; i < 64; ++i)
+		event.Subscribe(AddToTotal);
+	int value = 1;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(value);
+		event.Invoke(value);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("Event/Invoke void 64 subscribers")
+{
+	xe::Event<> event;
+	int count = 0;
+	for (int i = 0; i < 64; ++i)
+		event.Subscribe([&count]() { ++count; });
+	for (auto _ : state)
+		event.Invoke();
+	xe::DoNotOptimize(count);
+}
+
+XEMicroBenchmark("Event/Subscribe + Unsubscribe")
+{
+	xe::Event<int> event;
+	for (int i = 0; i < 64; ++i)
+		event.Subscribe(AddToTotal);
+	for (auto _ : state)
+	{
+		const xe::FuncID id = event.Subscribe(AddToTotal);
+		xe::DoNotOptimize(event.Unsubscribe(id));
+	}
+}
+
+XEMicroBenchmark("Event/Contains")
+{
+	xe::Event<int> event;
+	std::vector<xe::FuncID> ids;
+	for (int i = 0; i < 64; ++i)
+		ids.push_back(event.Subscribe(AddToTotal));
+	size_t index = 0;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(event.Contains(ids[index]));
+		index = (index + 1) & 63;
+	}
+}
+
+XEMicroBenchmark("PriorityEvent/Invoke 64 handlers, consumed at 4th")
+{
+	xe::PriorityEvent<int> event;
+	for (int i = 0; i < 64; ++i)
+	{
+		event.Subscribe([i](int value)
+		{
+			g_total += value;
+			return i == 60;
+		}, i);
+	}
+	int value = 1;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(value);
+		xe::DoNotOptimize(event.Invoke(value));
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("Event/Invoke 256 heavy subscribers")
+{
+	xe::Event<int> event;
+	for (int i = 0; i < 256; ++i)
+		event.Subscribe(HeavyWork);
+	int value = 1;
+	for (auto _ : state)
+		event.Invoke(value);
+	xe::DoNotOptimize(g_heavyTotal);
+}
+
+XEMicroBenchmark("Event/InvokeParallel 256 heavy subscribers")
+{
+	xe::Event<int> event;
+	for (int i = 0; i < 256; ++i)
+		event.SubscribeParallel(HeavyWork);
+	int value = 1;
+	for (auto _ : state)
+		event.InvokeParallel(value);
+	xe::DoNotOptimize(g_heavyTotal);
+}
+
+XEMicroBenchmark("EventBus/Publish 1 subscriber")
+{
+	struct Damage { int Amount; };
+	struct Spawn { int ID; };
+	struct Despawn { int ID; };
+
+	xe::EventBus<Spawn, Despawn, Damage> bus;
+	bus.Subscribe<Damage>([](const Damage& damage) { g_total += damage.Amount; });
+	Damage damage{ 1 };
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(damage);
+		bus.Publish(damage);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("DelegateEvent/Invoke 64 subscribers")
+{
+	xe::DelegateEvent<int> event;
+	for (int i = 0; i < 64; ++i)
+		event.Subscribe(AddToTotal);
+	int value = 1;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(value);
+		event.Invoke(value);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("DelegateEvent/Invoke 64 bound members")
+{
+	struct Counter
+	{
+		int Total = 0;
+		void Add(int value) { Total += value; }
+	};
+
+	std::vector<Counter> counters(64);
+	xe::DelegateEvent<int> event;
+	for (Counter& counter : counters)
+		event.Subscribe(xe::BindDelegate<&Counter::Add>(&counter));
+	int value = 1;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(value);
+		event.Invoke(value);
+	}
+	xe::DoNotOptimize(counters[0].Total);
+}
+
+XEMicroBenchmark("ConcurrentEvent/Invoke 64 subscribers")
+{
+	xe::ConcurrentEvent<int> event;
+	for (int i = 0; i < 64; ++i)
+		event.Subscribe(AddToTotal);
+	int value = 1;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(value);
+		event.Invoke(value);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("ConcurrentEvent/Subscribe + Unsubscribe 64 subscribers")
+{
+	xe::ConcurrentEvent<int> event;
+	for (int i = 0; i < 63; ++i)
+		event.Subscribe(AddToTotal);
+	for (auto _ : state)
+	{
+		xe::FuncID id = event.Subscribe(AddToTotal);
+		event.Unsubscribe(id);
+	}
+}
+
+XEMicroBenchmark("Event/Invoke 1024 payloads x 8 subscribers")
+{
+	xe::Event<int> event;
+	for (int i = 0; i < 8; ++i)
+		event.Subscribe(AddToTotal);
+	for (auto _ : state)
+	{
+		for (int i = 0; i < 1024; ++i)
+			event.Invoke(i);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("EventQueue/Enqueue + Dispatch 1024 payloads x 8 subscribers")
+{
+	xe::QueuedEvent<int> event;
+	event.ReservePayloads(1024);
+	for (int i = 0; i < 8; ++i)
+	{
+		event.Subscribe([](std::span<const int> values)
+		{
+			for (int value : values)
+				g_total += value;
+		});
+	}
+	std::vector<int> payloads(1024);
+	for (int i = 0; i < 1024; ++i)
+		payloads[i] = i;
+	for (auto _ : state)
+	{
+		event.EnqueueBatch(payloads);
+		event.Dispatch();
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("SpscQueue/PushBatch + DrainInto 1024 payloads")
+{
+	xe::SpscQueue<int, 1024> queue;
+	xe::Event<int> event;
+	event.Subscribe(AddToTotal);
+	std::vector<int> payloads(1024, 1);
+	for (auto _ : state)
+	{
+		queue.PushBatch(payloads);
+		xe::DrainInto(queue, event);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("MpscQueue/Push + DrainInto 1024 payloads")
+{
+	xe::MpscQueue<int, 1024> queue;
+	xe::Event<int> event;
+	event.Subscribe(AddToTotal);
+	for (auto _ : state)
+	{
+		for (int i = 0; i < 1024; ++i)
+			queue.Push(i);
+		xe::DrainInto(queue, event);
+	}
+	xe::DoNotOptimize(g_total);
+}
+
+XEMicroBenchmark("PriorityEvent/Unsubscribe 256 one by one")
+{
+	xe::PriorityEvent<int> event;
+	std::vector<xe::FuncID> ids(256);
+	for (auto _ : state)
+	{
+		for (int i = 0; i < 256; ++i)
+			ids[i] = event.Subscribe([](int) { return false; }, i & 7);
+		for (xe::FuncID id : ids)
+			event.Unsubscribe(id);
+	}
+}
+
+XEMicroBenchmark("PriorityEvent/SubscriptionGroup 256")
+{
+	xe::PriorityEvent<int> event;
+	xe::SubscriptionGroup group;
+	group.Reserve(256);
+	for (auto _ : state)
+	{
+		for (int i = 0; i < 256; ++i)
+			group.Add(xe::Subscription(event, event.Subscribe([](int) { return false; }, i & 7)));
+		group.Clear();
+	}
+}
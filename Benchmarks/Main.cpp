@@ -0,0 +1,5 @@
+// Runs every suite in this folder. Build together with the suites, src/Math.cpp and src/external/AES.cpp:
+//   Benchmarks --filter=Math/ --csv=math.csv
+#include <XephTools/MicroBenchmark.h>
+
+XEMicroBenchmarkMain
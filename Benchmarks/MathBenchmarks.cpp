@@ -0,0 +1,105 @@
+#include <XephTools/Math.h>
+#include <XephTools/MicroBenchmark.h>
+
+#include <vector>
+
+namespace
+{
+	std::vector<xe::Vector3> MakePoints(size_t count)
+	{
+		std::vector<xe::Vector3> points(count);
+		for (size_t i = 0; i < count; ++i)
+			points[i] = xe::Vector3(static_cast<float>(i) * 0.5f, static_cast<float>(i % 7) - 3.f, 1.f + static_cast<float>(i % 13));
+		return points;
+	}
+}
+
+XEMicroBenchmark("Math/Vector3 Dot")
+{
+	xe::Vector3 a(1.f, 2.f, 3.f);
+	xe::Vector3 b(4.f, 5.f, 6.f);
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(a);
+		xe::DoNotOptimize(xe::Dot(a, b));
+	}
+}
+
+XEMicroBenchmark("Math/Vector3 Cross")
+{
+	xe::Vector3 a(1.f, 2.f, 3.f);
+	xe::Vector3 b(4.f, 5.f, 6.f);
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(a);
+		xe::DoNotOptimize(xe::Cross(a, b));
+	}
+}
+
+XEMicroBenchmark("Math/Vector3 Normalize x1024")
+{
+	std::vector<xe::Vector3> points = MakePoints(1024);
+	state.SetBytesPerIteration(points.size() * sizeof(xe::Vector3));
+	for (auto _ : state)
+	{
+		for (xe::Vector3& point : points)
+			point = xe::Normalize(point);
+		xe::ClobberMemory();
+	}
+}
+
+XEMicroBenchmark("Math/Matrix4 Multiply")
+{
+	xe::Matrix4 a = xe::Matrix4::RotationX(0.3f) * xe::Matrix4::Translation(1.f, 2.f, 3.f);
+	xe::Matrix4 b = xe::Matrix4::RotationY(1.2f);
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(a);
+		xe::DoNotOptimize(a * b);
+	}
+}
+
+XEMicroBenchmark("Math/Matrix4 Inverse")
+{
+	xe::Matrix4 m = xe::Matrix4::RotationX(0.3f) * xe::Matrix4::RotationY(1.2f) * xe::Matrix4::Translation(1.f, 2.f, 3.f);
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(m);
+		xe::DoNotOptimize(xe::Inverse(m));
+	}
+}
+
+XEMicroBenchmark("Math/TransformCoord x1024")
+{
+	std::vector<xe::Vector3> points = MakePoints(1024);
+	const xe::Matrix4 m = xe::Matrix4::RotationY(0.7f) * xe::Matrix4::Translation(1.f, 2.f, 3.f);
+	state.SetBytesPerIteration(points.size() * sizeof(xe::Vector3));
+	for (auto _ : state)
+	{
+		for (xe::Vector3& point : points)
+			point = xe::TransformCoord(point, m);
+		xe::ClobberMemory();
+	}
+}
+
+XEMicroBenchmark("Math/Quaternion Slerp")
+{
+	xe::Quaternion a = xe::QuaternionFromAxisAngle(xe::Vector3::YAxis(), 30.f);
+	xe::Quaternion b = xe::QuaternionFromAxisAngle(xe::Vector3::XAxis(), 120.f);
+	float t = 0.25f;
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(t);
+		xe::DoNotOptimize(xe::Slerp(a, b, t));
+	}
+}
+
+XEMicroBenchmark("Math/QuaternionToMatrix")
+{
+	xe::Quaternion q = xe::QuaternionFromAxisAngle(xe::Vector3(1.f, 1.f, 0.f), 45.f);
+	for (auto _ : state)
+	{
+		xe::DoNotOptimize(q);
+		xe::DoNotOptimize(xe::QuaternionToMatrix(q));
+	}
+}
@@ -0,0 +1,29 @@
+// Converts binary xe::Benchmarker traces (TraceFormat::Binary) into JSON
+// that can be opened in chrome://tracing or https://ui.perfetto.dev
+//
+// Usage: TraceConverter <input> [output]
+
+#include <XephTools/BenchmarkTrace.h>
+
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: TraceConverter <input> [output]" << std::endl;
+		return 1;
+	}
+
+	std::filesystem::path input = argv[1];
+	std::filesystem::path output = (argc > 2) ? std::filesystem::path(argv[2]) : std::filesystem::path(input).replace_extension(".json");
+
+	if (!xe::ConvertTraceToJson(input, output))
+	{
+		std::cout << "[TraceConverter] Failed to convert " << input << std::endl;
+		return 1;
+	}
+
+	std::cout << "[TraceConverter] Wrote " << output << std::endl;
+	return 0;
+}
@@ -4,30 +4,445 @@
 #ifndef __XE_BENCHMARKER_H__
 #define __XE_BENCHMARKER_H__
 
-#include <string>
+#include "BenchmarkStats.h"
+#include "BenchmarkTrace.h"
+#include "Clock.h"
+
+#include <atomic>
 #include <chrono>
-#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <memory>
-
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
 #include <thread>
+#include <vector>
 
 #define DO_BENCHMARK
 
+// Number of events each thread can hold before the flusher drains them. Must be a power of 2.
+#ifndef XE_BENCHMARK_BUFFER_SIZE
+#define XE_BENCHMARK_BUFFER_SIZE 8192
+#endif // XE_BENCHMARK_BUFFER_SIZE
+
+#ifndef XE_BENCHMARK_FLUSH_INTERVAL_MS
+#define XE_BENCHMARK_FLUSH_INTERVAL_MS 10
+#endif // XE_BENCHMARK_FLUSH_INTERVAL_MS
+
+// Clock policy used for scope timestamps (see Clock.h). Timestamps are in nanoseconds.
+#ifndef XE_BENCHMARK_CLOCK
+#define XE_BENCHMARK_CLOCK xe::DefaultClock
+#endif // XE_BENCHMARK_CLOCK
+
+// Maximum number of distinct XEBenchmarkScope call sites. Site IDs are 16-bit.
+#ifndef XE_BENCHMARK_MAX_SITES
+#define XE_BENCHMARK_MAX_SITES 4096
+#endif // XE_BENCHMARK_MAX_SITES
+
+#if defined(_MSC_VER)
+#define XE_BENCHMARK_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define XE_BENCHMARK_NOINLINE __attribute__((noinline))
+#else
+#define XE_BENCHMARK_NOINLINE
+#endif
+
 namespace xe
 {
-    struct ProfileResult
+    struct BenchmarkSession
     {
         std::string Name;
-        long long Start, End;
-        uint32_t ThreadID;
+        BenchmarkSession() = default;
+        inline BenchmarkSession(const std::string& name) : Name(name) {}
     };
 
-    struct BenchmarkSession
+    // Innermost tracked BenchmarkTimer of a thread. Each scope links to the one it was opened in.
+    struct BenchmarkAllocationScope
     {
-        std::string Name;
-        BenchmarkSession() = default;
-        inline Benchmark(const std::string& name) : Name(name) {}
+        BenchmarkAllocationScope* Parent = nullptr;
+        uint32_t Count = 0;
+        uint64_t Bytes = 0;
+    };
+
+    // Backing for XEBenchmarkAllocationHooks. Nothing in here may allocate.
+    class BenchmarkAllocations
+    {
+    public:
+        // While one is alive, allocations on this thread are not counted. Held by the benchmarker
+        // around its own bookkeeping (site tables, thread buffers, histograms) so user scopes don't pay for it.
+        class Suspend
+        {
+        public:
+            Suspend() { ++t_suspended; }
+            ~Suspend() { --t_suspended; }
+
+            Suspend(const Suspend&) = delete;
+            Suspend& operator=(const Suspend&) = delete;
+        };
+
+        static bool IsEnabled()
+        {
+            return s_enabled.load(std::memory_order_relaxed);
+        }
+
+        // Set once by the static initializer XEBenchmarkAllocationHooks adds to the program
+        static bool Enable()
+        {
+            s_enabled.store(true, std::memory_order_relaxed);
+            return true;
+        }
+
+        static void Push(BenchmarkAllocationScope& scope)
+        {
+            scope.Parent = t_current;
+            t_current = &scope;
+        }
+
+        // Scopes are normally closed innermost first, but an early Stop() may close one further out
+        static void Pop(BenchmarkAllocationScope& scope)
+        {
+            if (t_current == &scope)
+            {
+                t_current = scope.Parent;
+                return;
+            }
+
+            for (BenchmarkAllocationScope* child = t_current; child; child = child->Parent)
+            {
+                if (child->Parent == &scope)
+                {
+                    child->Parent = scope.Parent;
+                    return;
+                }
+            }
+        }
+
+        static void* Allocate(std::size_t size)
+        {
+            BenchmarkAllocationScope* scope = t_current;
+            if (scope && t_suspended == 0)
+            {
+                ++scope->Count;
+                scope->Bytes += size;
+            }
+
+            while (true)
+            {
+                if (void* ptr = std::malloc(size ? size : 1))
+                    return ptr;
+
+                std::new_handler handler = std::get_new_handler();
+                if (!handler)
+                    throw std::bad_alloc();
+                handler();
+            }
+        }
+
+        static void* AllocateNoThrow(std::size_t size) noexcept
+        {
+            try
+            {
+                return Allocate(size);
+            }
+            catch (...)
+            {
+                return nullptr;
+            }
+        }
+
+        // Kept out of line: once inlined into a replaced operator delete, GCC pairs std::free with the
+        // caller's new expression and warns (-Wmismatched-new-delete)
+        XE_BENCHMARK_NOINLINE static void Free(void* ptr) noexcept
+        {
+            std::free(ptr);
+        }
+
+    private:
+        static inline std::atomic<bool> s_enabled = false;
+        static inline thread_local BenchmarkAllocationScope* t_current = nullptr;
+        static inline thread_local uint32_t t_suspended = 0;
+    };
+
+    // Static table of every registered call site. Sites are only ever appended, so readers need no lock.
+    class BenchmarkSites
+    {
+    private:
+        static_assert(XE_BENCHMARK_MAX_SITES > 1 && XE_BENCHMARK_MAX_SITES <= UINT16_MAX + 1, "XE_BENCHMARK_MAX_SITES must fit in a 16-bit site ID");
+
+    public:
+        static const uint16_t k_overflowSite = 0;
+
+        // Called once per call site from the XEBenchmarkScope static initializer
+        static uint16_t Register(const char* name, const char* file, uint32_t line, const char* function,
+            ProfileType type = ProfileType::Complete, uint32_t sampleRate = 1, uint32_t rateLimit = 0)
+        {
+            BenchmarkAllocations::Suspend suspend;
+            Table& table = GetTable();
+            std::lock_guard<std::mutex> lock(table.Mutex);
+            return RegisterLocked(table, name, file, line, function, type, sampleRate, rateLimit);
+        }
+
+        // Companion site that receives the allocations made inside a scope site. Registered on first use.
+        static uint16_t AllocationSite(uint16_t scopeSite)
+        {
+            Table& table = GetTable();
+            const uint16_t cached = table.AllocationSites[scopeSite].load(std::memory_order_acquire);
+            if (cached != k_overflowSite)
+                return cached;
+
+            std::lock_guard<std::mutex> lock(table.Mutex);
+            uint16_t id = table.AllocationSites[scopeSite].load(std::memory_order_relaxed);
+            if (id == k_overflowSite)
+            {
+                const BenchmarkSite& scope = table.Sites[scopeSite];
+                const std::string name = scope.Name + " allocations";
+                id = RegisterLocked(table, name.c_str(), scope.File.c_str(), scope.Line, scope.Function.c_str(),
+                    ProfileType::Allocation, scope.SampleRate, scope.RateLimit);
+                table.AllocationSites[scopeSite].store(id, std::memory_order_release);
+            }
+            return id;
+        }
+
+        static const BenchmarkSite& Get(uint16_t id)
+        {
+            return GetTable().Sites[id];
+        }
+
+        static size_t Count()
+        {
+            return GetTable().Count.load(std::memory_order_acquire);
+        }
+
+    private:
+        struct Table
+        {
+            Table()
+            {
+                Sites[k_overflowSite].Name = "<site table full>";
+                Count.store(1, std::memory_order_relaxed);
+                for (std::atomic<uint16_t>& site : AllocationSites)
+                    site.store(k_overflowSite, std::memory_order_relaxed);
+            }
+
+            std::mutex Mutex;
+            std::atomic<size_t> Count;
+            BenchmarkSite Sites[XE_BENCHMARK_MAX_SITES];
+            std::atomic<uint16_t> AllocationSites[XE_BENCHMARK_MAX_SITES];
+        };
+
+        static uint16_t RegisterLocked(Table& table, const char* name, const char* file, uint32_t line, const char* function,
+            ProfileType type, uint32_t sampleRate, uint32_t rateLimit)
+        {
+            const size_t id = table.Count.load(std::memory_order_relaxed);
+            if (id >= XE_BENCHMARK_MAX_SITES)
+                return k_overflowSite;
+
+            BenchmarkSite& site = table.Sites[id];
+            site.Name = name;
+            site.File = file;
+            site.Line = line;
+            site.Function = function;
+            site.Type = type;
+            site.SampleRate = std::max<uint32_t>(sampleRate, 1);
+            site.RateLimit = rateLimit;
+            table.Count.store(id + 1, std::memory_order_release);
+            return static_cast<uint16_t>(id);
+        }
+
+        static Table& GetTable()
+        {
+            static Table table;
+            return table;
+        }
+    };
+
+    // Per thread, per site state of a sampled scope. Returns the weight to record, or 0 to skip this invocation.
+    class BenchmarkSampler
+    {
+    public:
+        uint32_t OneIn(uint32_t rate)
+        {
+            if (++_counter < rate)
+                return 0;
+
+            _counter = 0;
+            return rate;
+        }
+
+        // Samples are spread over the window as 1 in (calls last window / limit), capped at `limit` per window.
+        // A limit of 0 is treated as 1.
+        uint32_t PerSecond(uint32_t limit)
+        {
+            if (limit == 0)
+                limit = 1;
+            const uint32_t epoch = s_epoch.load(std::memory_order_relaxed);
+            if (epoch != _epoch)
+            {
+                _rate = (_calls > limit) ? _calls / limit : 1;
+                _budget = limit;
+                _calls = 0;
+                _counter = 0;
+                _epoch = epoch;
+            }
+
+            ++_calls;
+            ++_skipped;
+            if (++_counter < _rate || _budget == 0)
+                return 0;
+
+            _counter = 0;
+            --_budget;
+            const uint32_t weight = _skipped;
+            _skipped = 0;
+            return weight;
+        }
+
+        // Starts a new rate limit window. Advanced once per second by the Benchmarker flusher thread.
+        static void AdvanceEpoch()
+        {
+            s_epoch.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    private:
+        static inline std::atomic<uint32_t> s_epoch = 1;
+
+        uint32_t _counter = 0;
+        uint32_t _skipped = 0;
+        uint32_t _epoch = 0;
+        uint32_t _calls = 0;
+        uint32_t _rate = 1;
+        uint32_t _budget = 0;
+    };
+
+    enum class BenchmarkMode
+    {
+        Trace,      // Every event is written to the trace file
+        Aggregate,  // Per scope histograms only, summary table written on EndSession
+    };
+
+    // Single producer (owning thread), single consumer (flusher thread) ring of fixed-size events.
+    class BenchmarkBuffer
+    {
+    private:
+        static_assert((XE_BENCHMARK_BUFFER_SIZE & (XE_BENCHMARK_BUFFER_SIZE - 1)) == 0, "XE_BENCHMARK_BUFFER_SIZE must be a power of 2");
+        static const size_t k_mask = XE_BENCHMARK_BUFFER_SIZE - 1;
+
+    public:
+        BenchmarkBuffer(uint32_t threadID)
+            : ThreadID(threadID), _histograms(std::make_unique<std::atomic<BenchmarkThreadHistogram*>[]>(XE_BENCHMARK_MAX_SITES))
+        {
+            for (size_t i = 0; i < XE_BENCHMARK_MAX_SITES; ++i)
+                _histograms[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        ~BenchmarkBuffer()
+        {
+            for (size_t i = 0; i < XE_BENCHMARK_MAX_SITES; ++i)
+                delete _histograms[i].load(std::memory_order_relaxed);
+        }
+
+        BenchmarkBuffer(const BenchmarkBuffer& other) = delete;
+        BenchmarkBuffer& operator=(const BenchmarkBuffer& other) = delete;
+
+        bool Push(const ProfileResult& result)
+        {
+            const size_t head = _head.load(std::memory_order_relaxed);
+            if (head - _tail.load(std::memory_order_acquire) > k_mask)
+            {
+                _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            _events[head & k_mask] = result;
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Calls func(events, count) for each contiguous span of pending events
+        template <typename Func>
+        size_t Drain(Func&& func)
+        {
+            const size_t tail = _tail.load(std::memory_order_relaxed);
+            const size_t head = _head.load(std::memory_order_acquire);
+            const size_t count = head - tail;
+            if (count == 0)
+                return 0;
+
+            const size_t first = tail & k_mask;
+            const size_t firstCount = std::min(count, XE_BENCHMARK_BUFFER_SIZE - first);
+            func(_events + first, firstCount);
+            if (firstCount < count)
+                func(_events, count - firstCount);
+
+            _tail.store(head, std::memory_order_release);
+            return count;
+        }
+
+        void Discard()
+        {
+            _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        // Aggregate mode: histograms are created the first time this thread hits a site, then reused
+        void Record(uint16_t siteID, uint64_t value, uint32_t weight, uint64_t secondary = 0)
+        {
+            BenchmarkThreadHistogram* histogram = _histograms[siteID].load(std::memory_order_relaxed);
+            if (!histogram)
+            {
+                histogram = new BenchmarkThreadHistogram();
+                _histograms[siteID].store(histogram, std::memory_order_release);
+            }
+            histogram->Record(value, weight, secondary);
+        }
+
+        void MergeInto(std::vector<BenchmarkStats>& stats) const
+        {
+            const size_t siteCount = BenchmarkSites::Count();
+            if (stats.size() < siteCount)
+                stats.resize(siteCount);
+
+            for (size_t i = 0; i < siteCount; ++i)
+            {
+                const BenchmarkThreadHistogram* histogram = _histograms[i].load(std::memory_order_acquire);
+                if (histogram)
+                    stats[i].Merge(*histogram);
+            }
+        }
+
+        void ResetHistograms()
+        {
+            for (size_t i = 0; i < XE_BENCHMARK_MAX_SITES; ++i)
+            {
+                BenchmarkThreadHistogram* histogram = _histograms[i].load(std::memory_order_acquire);
+                if (histogram)
+                    histogram->Reset();
+            }
+        }
+
+        size_t TakeDropped()
+        {
+            const size_t dropped = _dropped.load(std::memory_order_relaxed);
+            const size_t result = dropped - _droppedSeen;
+            _droppedSeen = dropped;
+            return result;
+        }
+
+        const uint32_t ThreadID;
+        std::atomic<bool> Retired = false;
+
+    private:
+        alignas(64) std::atomic<size_t> _head = 0;
+        alignas(64) std::atomic<size_t> _tail = 0;
+        std::atomic<size_t> _dropped = 0;
+        size_t _droppedSeen = 0;
+        std::unique_ptr<std::atomic<BenchmarkThreadHistogram*>[]> _histograms;
+        ProfileResult _events[XE_BENCHMARK_BUFFER_SIZE];
     };
 
     class Benchmarker
@@ -35,59 +450,351 @@ namespace xe
     private:
         std::unique_ptr<BenchmarkSession> _currentSession;
         std::ofstream _outputStream;
-        int _profileCount;
+        std::unique_ptr<TraceWriter> _writer;
+        size_t _droppedCount;
+        size_t _sitesWritten;
+        uint32_t _nsPerTick;
+
+        std::atomic<bool> _active;
+        std::atomic<BenchmarkMode> _mode;
+        std::mutex _bufferMutex;
+        std::vector<std::shared_ptr<BenchmarkBuffer>> _buffers;
+        std::vector<BenchmarkStats> _retiredStats; // Aggregate mode: histograms of threads that have exited
+
+        std::ostream* _summaryStream;
+        std::chrono::steady_clock::duration _summaryInterval;
+        std::chrono::steady_clock::time_point _sessionStart;
+        std::chrono::steady_clock::time_point _lastSummary;
+
+        std::thread _flushThread;
+        std::mutex _flushMutex;
+        std::condition_variable _flushCondition;
+        bool _stopFlush;
+
+        // Keeps the calling thread's buffer alive and hands it back to the flusher when the thread exits
+        struct ThreadBufferHandle
+        {
+            Benchmarker* Owner = nullptr;
+            std::shared_ptr<BenchmarkBuffer> Buffer;
+
+            ~ThreadBufferHandle()
+            {
+                if (Buffer)
+                    Buffer->Retired.store(true, std::memory_order_release);
+            }
+        };
+
     public:
         Benchmarker()
-            : _currentSession(nullptr), _profileCount(0)
+            : _currentSession(nullptr), _droppedCount(0), _sitesWritten(0), _nsPerTick(1), _active(false), _mode(BenchmarkMode::Trace)
+            , _summaryStream(nullptr), _summaryInterval(std::chrono::seconds(10)), _stopFlush(false)
+        {
+        }
+
+        ~Benchmarker()
         {
+            if (_currentSession)
+                EndSession();
         }
 
-        void BeginSession(const std::string& name, const std::string& filepath = "results.json")
+        Benchmarker(const Benchmarker& other) = delete;
+        Benchmarker& operator=(const Benchmarker& other) = delete;
+
+        void BeginSession(const std::string& name, const std::string& filepath = "results.json", TraceFormat format = TraceFormat::Json)
         {
-            _outputStream.open(filepath);
-            WriteHeader();
+            if (_currentSession)
+                EndSession();
+
+            XE_BENCHMARK_CLOCK::Calibrate();
+
+            if (GetMode() == BenchmarkMode::Aggregate)
+            {
+                _outputStream.open(filepath);
+            }
+            else if (format == TraceFormat::Binary)
+            {
+                _outputStream.open(filepath, std::ios::binary);
+                _writer = std::make_unique<BinaryTraceWriter>(_outputStream);
+            }
+            else
+            {
+                _outputStream.open(filepath);
+                _writer = std::make_unique<JsonTraceWriter>(_outputStream);
+            }
             _currentSession = std::make_unique<BenchmarkSession>(name);
+            if (_writer)
+                _writer->WriteHeader(name, _nsPerTick);
+            _sitesWritten = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(_bufferMutex);
+                for (std::shared_ptr<BenchmarkBuffer>& buffer : _buffers)
+                {
+                    buffer->Discard();
+                    buffer->TakeDropped();
+                    buffer->ResetHistograms();
+                }
+                _retiredStats.clear();
+            }
+
+            _sessionStart = _lastSummary = std::chrono::steady_clock::now();
+
+            _stopFlush = false;
+            _active.store(true, std::memory_order_release);
+            _flushThread = std::thread(&Benchmarker::FlushLoop, this);
         }
 
         void EndSession()
         {
-            WriteFooter();
+            if (!_currentSession)
+                return;
+
+            _active.store(false, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(_flushMutex);
+                _stopFlush = true;
+            }
+            _flushCondition.notify_one();
+            if (_flushThread.joinable())
+                _flushThread.join();
+
+            Flush();
+            if (_writer)
+                _writer->WriteFooter(_droppedCount);
+            else
+                WriteSummary(_outputStream);
             _outputStream.close();
+            _writer = nullptr;
             _currentSession = nullptr;
-            _profileCount = 0;
+            _droppedCount = 0;
+        }
+
+        bool IsActive() const
+        {
+            return _active.load(std::memory_order_relaxed);
+        }
+
+        // Takes effect on the next BeginSession
+        void SetMode(BenchmarkMode mode)
+        {
+            if (!_currentSession)
+                _mode.store(mode, std::memory_order_relaxed);
+        }
+
+        BenchmarkMode GetMode() const
+        {
+            return _mode.load(std::memory_order_relaxed);
+        }
+
+        // Aggregate mode: also write the summary table to `stream` every `intervalSeconds` while a session runs. nullptr disables.
+        void SetSummaryStream(std::ostream* stream, float intervalSeconds = 10.f)
+        {
+            std::lock_guard<std::mutex> lock(_flushMutex);
+            _summaryStream = stream;
+            _summaryInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(intervalSeconds));
         }
 
+        // Hot path: copies the result into the calling thread's ring buffer, or its histogram in aggregate mode. Never blocks.
         void WriteProfile(const ProfileResult& result)
         {
-            if (_profileCount++ > 0)
-                _outputStream << ",";
+            if (!IsActive())
+                return;
 
-            std::string name = result.Name;
-            std::replace(name.begin(), name.end(), '"', '\'');
+            // The lazily created thread buffer and histograms are not charged to the enclosing scope
+            BenchmarkAllocations::Suspend suspend;
+            if (GetMode() == BenchmarkMode::Aggregate)
+                ThreadBuffer().Record(result.SiteID, AggregateValue(result), result.Weight, (result.Type == ProfileType::Allocation) ? result.Allocations.Count : 0);
+            else
+                ThreadBuffer().Push(result);
+        }
+
+        void WriteCounter(uint16_t siteID, double value)
+        {
+            ProfileResult result{};
+            result.SiteID = siteID;
+            result.Type = ProfileType::Counter;
+            result.Weight = 1;
+            result.Start = XE_BENCHMARK_CLOCK::Now();
+            result.Value = value;
+            WriteProfile(result);
+        }
+
+        void WriteInstant(uint16_t siteID)
+        {
+            ProfileResult result{};
+            result.SiteID = siteID;
+            result.Type = ProfileType::Instant;
+            result.Weight = 1;
+            result.Start = XE_BENCHMARK_CLOCK::Now();
+            result.End = result.Start;
+            WriteProfile(result);
+        }
 
-            _outputStream << "{";
-            _outputStream << "\"cat\":\"function\",";
-            _outputStream << "\"dur\":" << (result.End - result.Start) << ',';
-            _outputStream << "\"name\":\"" << name << "\",";
-            _outputStream << "\"ph\":\"X\",";
-            _outputStream << "\"pid\":0,";
-            _outputStream << "\"tid\":" << result.ThreadID << ",";
-            _outputStream << "\"ts\":" << result.Start;
-            _outputStream << "}";
+        // Flow events with the same id are linked across threads. The begin/step/end binds to the enclosing scope.
+        void WriteFlow(uint16_t siteID, ProfileType type, uint64_t flowID)
+        {
+            ProfileResult result{};
+            result.SiteID = siteID;
+            result.Type = type;
+            result.Weight = 1;
+            result.Start = XE_BENCHMARK_CLOCK::Now();
+            result.FlowID = flowID;
+            WriteProfile(result);
+        }
+
+        void WriteAllocations(uint16_t scopeSite, uint32_t weight, long long start, const BenchmarkAllocationScope& scope)
+        {
+            if (!IsActive())
+                return;
 
-            _outputStream.flush();
+            BenchmarkAllocations::Suspend suspend;
+            ProfileResult result{};
+            result.SiteID = BenchmarkSites::AllocationSite(scopeSite);
+            result.Type = ProfileType::Allocation;
+            result.Weight = weight;
+            result.Start = start;
+            result.Allocations = { scope.Count, static_cast<uint32_t>(std::min<uint64_t>(scope.Bytes, UINT32_MAX)) };
+            WriteProfile(result);
+        }
+
+        // Unique id to pass along with work handed to another thread
+        static uint64_t NewFlowID()
+        {
+            static std::atomic<uint64_t> nextID = 1;
+            return nextID.fetch_add(1, std::memory_order_relaxed);
         }
 
-        void WriteHeader()
+        // Merges the histograms of every thread and writes one row per scope, sorted by total time,
+        // followed by the allocations of each scope (when XEBenchmarkAllocationHooks is used)
+        void WriteSummary(std::ostream& stream)
         {
-            _outputStream << "{\"otherData\": {},\"traceEvents\":[";
-            _outputStream.flush();
+            std::vector<BenchmarkStats> stats;
+            {
+                std::lock_guard<std::mutex> lock(_bufferMutex);
+                stats = _retiredStats;
+                for (std::shared_ptr<BenchmarkBuffer>& buffer : _buffers)
+                    buffer->MergeInto(stats);
+            }
+
+            std::vector<uint16_t> order;
+            std::vector<uint16_t> allocations;
+            for (size_t i = 0; i < stats.size(); ++i)
+            {
+                if (stats[i].Count == 0)
+                    continue;
+
+                if (BenchmarkSites::Get(static_cast<uint16_t>(i)).Type == ProfileType::Allocation)
+                    allocations.push_back(static_cast<uint16_t>(i));
+                else
+                    order.push_back(static_cast<uint16_t>(i));
+            }
+            std::sort(order.begin(), order.end(), [&stats](uint16_t a, uint16_t b) { return stats[a].Total > stats[b].Total; });
+            std::sort(allocations.begin(), allocations.end(), [&stats](uint16_t a, uint16_t b) { return stats[a].Total > stats[b].Total; });
+
+            const double usPerTick = _nsPerTick / 1000.0;
+            const char* kinds[] = { "", " (counter)", " (instant)", " (flow)", " (flow)", " (flow)" };
+            const float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - _sessionStart).count();
+
+            stream << "[xe::Benchmarker] " << (_currentSession ? _currentSession->Name : "") << " - " << elapsed << "s\n";
+            const std::ios::fmtflags flags = stream.flags();
+            const char fill = stream.fill(' ');
+            stream << std::left << std::setw(48) << "Scope" << std::right
+                << std::setw(12) << "Count" << std::setw(12) << "Total ms" << std::setw(11) << "Mean us"
+                << std::setw(11) << "Min us" << std::setw(11) << "p50 us" << std::setw(11) << "p90 us"
+                << std::setw(11) << "p99 us" << std::setw(11) << "p99.9 us" << std::setw(11) << "Max us" << "\n";
+
+            stream << std::fixed << std::setprecision(2);
+            for (uint16_t siteID : order)
+            {
+                const BenchmarkStats& site = stats[siteID];
+                const BenchmarkSite& info = BenchmarkSites::Get(siteID);
+                std::string name = info.Name;
+                if (info.RateLimit != 0)
+                    name += " [" + std::to_string(info.RateLimit) + "/s]";
+                else if (info.SampleRate != 1)
+                    name += " [1/" + std::to_string(info.SampleRate) + "]";
+                name += kinds[static_cast<size_t>(info.Type)];
+
+                // Only scopes are timed, counters report their raw value
+                const bool isTimed = info.Type == ProfileType::Complete;
+                const double scale = isTimed ? usPerTick : 1.0;
+                if (name.length() > 47)
+                    name = name.substr(0, 44) + "...";
+
+                stream << std::left << std::setw(48) << name << std::right
+                    << std::setw(12) << site.Count
+                    << std::setw(12) << site.Total * scale / (isTimed ? 1000.0 : 1.0)
+                    << std::setw(11) << site.Mean() * scale
+                    << std::setw(11) << site.Min * scale
+                    << std::setw(11) << site.Percentile(0.5) * scale
+                    << std::setw(11) << site.Percentile(0.9) * scale
+                    << std::setw(11) << site.Percentile(0.99) * scale
+                    << std::setw(11) << site.Percentile(0.999) * scale
+                    << std::setw(11) << site.Max * scale << "\n";
+            }
+
+            // Count is the number of scope invocations that allocated, the histogram is of bytes per invocation
+            if (!allocations.empty())
+            {
+                stream << "\n" << std::left << std::setw(48) << "Allocations" << std::right
+                    << std::setw(12) << "Scopes" << std::setw(12) << "Allocs" << std::setw(11) << "Allocs/sc"
+                    << std::setw(12) << "Total KiB" << std::setw(11) << "Mean B" << std::setw(11) << "p50 B"
+                    << std::setw(11) << "p99 B" << std::setw(11) << "Max B" << "\n";
+            }
+            for (uint16_t siteID : allocations)
+            {
+                const BenchmarkStats& site = stats[siteID];
+                std::string name = BenchmarkSites::Get(siteID).Name;
+                if (name.length() > 47)
+                    name = name.substr(0, 44) + "...";
+
+                stream << std::left << std::setw(48) << name << std::right
+                    << std::setw(12) << site.Count
+                    << std::setw(12) << site.Secondary
+                    << std::setw(11) << static_cast<double>(site.Secondary) / static_cast<double>(site.Count)
+                    << std::setw(12) << site.Total / 1024.0
+                    << std::setw(11) << site.Mean()
+                    << std::setw(11) << site.Percentile(0.5)
+                    << std::setw(11) << site.Percentile(0.99)
+                    << std::setw(11) << site.Max << "\n";
+            }
+            stream.flags(flags);
+            stream.fill(fill);
+            stream.flush();
         }
 
-        void WriteFooter()
+        // Drains every thread buffer into the output file. Called periodically by the flusher thread.
+        void Flush()
         {
-            _outputStream << "]}";
-            _outputStream.flush();
+            std::lock_guard<std::mutex> lock(_bufferMutex);
+            for (auto it = _buffers.begin(); it != _buffers.end();)
+            {
+                BenchmarkBuffer& buffer = **it;
+                const bool retired = buffer.Retired.load(std::memory_order_acquire);
+
+                if (_writer)
+                {
+                    buffer.Drain([this, &buffer](const ProfileResult* events, size_t count)
+                        {
+                            WriteNewSites();
+                            _writer->WriteEvents(buffer.ThreadID, events, count);
+                        });
+                }
+                _droppedCount += buffer.TakeDropped();
+
+                if (retired)
+                {
+                    if (_currentSession && GetMode() == BenchmarkMode::Aggregate)
+                        buffer.MergeInto(_retiredStats);
+                    it = _buffers.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            if (_writer)
+                _writer->Flush();
         }
 
         static Benchmarker& Get()
@@ -95,17 +802,102 @@ namespace xe
             static Benchmarker instance;
             return instance;
         }
+
+    private:
+        BenchmarkBuffer& ThreadBuffer()
+        {
+            thread_local ThreadBufferHandle handle;
+            if (handle.Owner != this)
+            {
+                if (handle.Buffer)
+                    handle.Buffer->Retired.store(true, std::memory_order_release);
+
+                uint32_t threadID = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+                handle.Buffer = std::make_shared<BenchmarkBuffer>(threadID);
+                handle.Owner = this;
+
+                std::lock_guard<std::mutex> lock(_bufferMutex);
+                _buffers.push_back(handle.Buffer);
+            }
+            return *handle.Buffer;
+        }
+
+        // Scopes aggregate their duration, counters their value (both clamped to >= 0), allocations their bytes, instants and flows only count
+        static uint64_t AggregateValue(const ProfileResult& result)
+        {
+            switch (result.Type)
+            {
+            case ProfileType::Complete:
+                return (result.End > result.Start) ? static_cast<uint64_t>(result.End - result.Start) : 0;
+            case ProfileType::Counter:
+                return (result.Value > 0.0) ? static_cast<uint64_t>(result.Value) : 0;
+            case ProfileType::Allocation:
+                return result.Allocations.Bytes;
+            default:
+                return 0;
+            }
+        }
+
+        // Site metadata is written once per session, before the first event that can reference it
+        void WriteNewSites()
+        {
+            const size_t count = BenchmarkSites::Count();
+            for (; _sitesWritten < count; ++_sitesWritten)
+            {
+                const uint16_t siteID = static_cast<uint16_t>(_sitesWritten);
+                _writer->WriteSite(siteID, BenchmarkSites::Get(siteID));
+            }
+        }
+
+        void FlushLoop()
+        {
+            std::chrono::steady_clock::time_point lastEpoch = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(_flushMutex);
+            while (!_stopFlush)
+            {
+                _flushCondition.wait_for(lock, std::chrono::milliseconds(XE_BENCHMARK_FLUSH_INTERVAL_MS), [this]() { return _stopFlush; });
+
+                lock.unlock();
+                Flush();
+                lock.lock();
+
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (now - lastEpoch >= std::chrono::seconds(1))
+                {
+                    lastEpoch = now;
+                    BenchmarkSampler::AdvanceEpoch();
+                }
+
+                if (_summaryStream && GetMode() == BenchmarkMode::Aggregate && now - _lastSummary >= _summaryInterval)
+                {
+                    _lastSummary = now;
+                    WriteSummary(*_summaryStream);
+                }
+            }
+        }
     };
 
     class BenchmarkTimer
     {
     public:
-        BenchmarkTimer(const char* name)
-            : _name(name), _stopped(false)
+        // A weight of 0 means the invocation was not sampled and nothing is recorded
+        BenchmarkTimer(uint16_t siteID, uint32_t weight = 1)
+            : _siteID(siteID), _weight(weight), _stopped(weight == 0), _tracking(false)
         {
-            _startTimepoint = std::chrono::high_resolution_clock::now();
+            if (_stopped)
+                return;
+
+            if (BenchmarkAllocations::IsEnabled())
+            {
+                _tracking = true;
+                BenchmarkAllocations::Push(_allocations);
+            }
+            _start = XE_BENCHMARK_CLOCK::Now();
         }
 
+        BenchmarkTimer(const BenchmarkTimer& other) = delete;
+        BenchmarkTimer& operator=(const BenchmarkTimer& other) = delete;
+
         ~BenchmarkTimer()
         {
             if (!_stopped)
@@ -114,29 +906,101 @@ namespace xe
 
         void Stop()
         {
-            auto endTimepoint = std::chrono::high_resolution_clock::now();
+            const long long end = XE_BENCHMARK_CLOCK::Now();
+            _stopped = true;
 
-            long long start = std::chrono::time_point_cast<std::chrono::microseconds>(_startTimepoint).time_since_epoch().count();
-            long long end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch().count();
+            if (_tracking)
+                BenchmarkAllocations::Pop(_allocations);
 
-            uint32_t threadID = std::hash<std::thread::id>{}(std::this_thread::get_id());
-            Benchmarker::Get().WriteProfile({ _name, start, end, threadID });
+            Benchmarker::Get().WriteProfile({ _siteID, ProfileType::Complete, _weight, _start, end });
 
-            _stopped = true;
+            if (_tracking && _allocations.Count > 0)
+                Benchmarker::Get().WriteAllocations(_siteID, _weight, _start, _allocations);
+            _tracking = false;
         }
     private:
-        const char* _name;
-        std::chrono::time_point<std::chrono::high_resolution_clock> _startTimepoint;
+        uint16_t _siteID;
+        uint32_t _weight;
+        long long _start;
         bool _stopped;
+        bool _tracking;
+        BenchmarkAllocationScope _allocations;
     };
 }
 
+#define XE_BENCHMARK_CONCAT_IMPL(a, b) a##b
+#define XE_BENCHMARK_CONCAT(a, b) XE_BENCHMARK_CONCAT_IMPL(a, b)
+
+#ifdef _MSC_VER
+#define XE_BENCHMARK_FUNCSIG __FUNCSIG__
+#else
+#define XE_BENCHMARK_FUNCSIG __PRETTY_FUNCTION__
+#endif // _MSC_VER
+
+// Registers the call site once (static local), then only the 16-bit site ID is recorded per event
+#define XE_BENCHMARK_SITE(name) XE_BENCHMARK_TYPED_SITE(name, xe::ProfileType::Complete)
+#define XE_BENCHMARK_TYPED_SITE(name, type) \
+    static const uint16_t XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__) = xe::BenchmarkSites::Register(name, __FILE__, __LINE__, XE_BENCHMARK_FUNCSIG, type)
+
 #ifdef DO_BENCHMARK
-#define XEBenchmarkScope(name) xe::BenchmarkTimer timer##__LINE__(name)
-#define XEBenchmarkFunction XEBenchmarkScope(__FUNCSIG__)
+#define XEBenchmarkScope(name) \
+    XE_BENCHMARK_SITE(name); \
+    xe::BenchmarkTimer XE_BENCHMARK_CONCAT(xeBenchmarkTimer, __LINE__)(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__))
+#define XEBenchmarkFunction XEBenchmarkScope(XE_BENCHMARK_FUNCSIG)
+
+// Records 1 in `rate` invocations per thread; each recorded event carries a weight of `rate`
+#define XEBenchmarkScopeSampled(name, rate) \
+    static const uint16_t XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__) = xe::BenchmarkSites::Register(name, __FILE__, __LINE__, XE_BENCHMARK_FUNCSIG, xe::ProfileType::Complete, rate, 0); \
+    static thread_local xe::BenchmarkSampler XE_BENCHMARK_CONCAT(xeBenchmarkSampler, __LINE__); \
+    xe::BenchmarkTimer XE_BENCHMARK_CONCAT(xeBenchmarkTimer, __LINE__)(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__), XE_BENCHMARK_CONCAT(xeBenchmarkSampler, __LINE__).OneIn(rate))
+#define XEBenchmarkFunctionSampled(rate) XEBenchmarkScopeSampled(XE_BENCHMARK_FUNCSIG, rate)
+
+// Records at most `limit` invocations per second per thread; each event is weighted by the invocations it stands for
+#define XEBenchmarkScopeRateLimited(name, limit) \
+    static const uint16_t XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__) = xe::BenchmarkSites::Register(name, __FILE__, __LINE__, XE_BENCHMARK_FUNCSIG, xe::ProfileType::Complete, 1, ((limit) > 0) ? (limit) : 1); \
+    static thread_local xe::BenchmarkSampler XE_BENCHMARK_CONCAT(xeBenchmarkSampler, __LINE__); \
+    xe::BenchmarkTimer XE_BENCHMARK_CONCAT(xeBenchmarkTimer, __LINE__)(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__), XE_BENCHMARK_CONCAT(xeBenchmarkSampler, __LINE__).PerSecond(limit))
+#define XEBenchmarkFunctionRateLimited(limit) XEBenchmarkScopeRateLimited(XE_BENCHMARK_FUNCSIG, limit)
+
+#define XEBenchmarkCounter(name, value) \
+    do { XE_BENCHMARK_TYPED_SITE(name, xe::ProfileType::Counter); xe::Benchmarker::Get().WriteCounter(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__), static_cast<double>(value)); } while (false)
+#define XEBenchmarkInstant(name) \
+    do { XE_BENCHMARK_TYPED_SITE(name, xe::ProfileType::Instant); xe::Benchmarker::Get().WriteInstant(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__)); } while (false)
+#define XEBenchmarkFlowBegin(name, id) \
+    do { XE_BENCHMARK_TYPED_SITE(name, xe::ProfileType::FlowBegin); xe::Benchmarker::Get().WriteFlow(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__), xe::ProfileType::FlowBegin, id); } while (false)
+#define XEBenchmarkFlowStep(name, id) \
+    do { XE_BENCHMARK_TYPED_SITE(name, xe::ProfileType::FlowStep); xe::Benchmarker::Get().WriteFlow(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__), xe::ProfileType::FlowStep, id); } while (false)
+#define XEBenchmarkFlowEnd(name, id) \
+    do { XE_BENCHMARK_TYPED_SITE(name, xe::ProfileType::FlowEnd); xe::Benchmarker::Get().WriteFlow(XE_BENCHMARK_CONCAT(xeBenchmarkSite, __LINE__), xe::ProfileType::FlowEnd, id); } while (false)
+
+// Opt-in: place once in a single .cpp file (at global scope) to replace the global operator new/delete.
+// Heap allocations are then counted against the innermost active scope of the allocating thread.
+// Over-aligned (std::align_val_t) allocations keep the default operators and are not counted.
+#define XEBenchmarkAllocationHooks \
+    void* operator new(std::size_t size) { return xe::BenchmarkAllocations::Allocate(size); } \
+    void* operator new[](std::size_t size) { return xe::BenchmarkAllocations::Allocate(size); } \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return xe::BenchmarkAllocations::AllocateNoThrow(size); } \
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return xe::BenchmarkAllocations::AllocateNoThrow(size); } \
+    void operator delete(void* ptr) noexcept { xe::BenchmarkAllocations::Free(ptr); } \
+    void operator delete[](void* ptr) noexcept { xe::BenchmarkAllocations::Free(ptr); } \
+    void operator delete(void* ptr, std::size_t) noexcept { xe::BenchmarkAllocations::Free(ptr); } \
+    void operator delete[](void* ptr, std::size_t) noexcept { xe::BenchmarkAllocations::Free(ptr); } \
+    void operator delete(void* ptr, const std::nothrow_t&) noexcept { xe::BenchmarkAllocations::Free(ptr); } \
+    void operator delete[](void* ptr, const std::nothrow_t&) noexcept { xe::BenchmarkAllocations::Free(ptr); } \
+    static const bool xeBenchmarkAllocationHooksEnabled = xe::BenchmarkAllocations::Enable()
 #else
 #define XEBenchmarkScope(name)
 #define XEBenchmarkFunction
+#define XEBenchmarkScopeSampled(name, rate)
+#define XEBenchmarkFunctionSampled(rate)
+#define XEBenchmarkScopeRateLimited(name, limit)
+#define XEBenchmarkFunctionRateLimited(limit)
+#define XEBenchmarkCounter(name, value)
+#define XEBenchmarkInstant(name)
+#define XEBenchmarkFlowBegin(name, id)
+#define XEBenchmarkFlowStep(name, id)
+#define XEBenchmarkFlowEnd(name, id)
+#define XEBenchmarkAllocationHooks static_assert(true, "")
 #endif // DO_BENCHMARK
 
 #endif //__XE_BENCHMARKER_H__
@@ -0,0 +1,212 @@
+/*========================================================
+
+ XephTools - Benchmark Stats
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Histograms are log-bucketed (HDR style): values below 32 are exact, above that every
+	power of 2 is split into 32 linear sub-buckets, so any recorded value is within ~3%.
+  - Memory per histogram is fixed (k_bucketCount counters) no matter how many values are recorded.
+
+========================================================*/
+
+#ifndef XE_BENCHMARKSTATS_H
+#define XE_BENCHMARKSTATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace xe
+{
+	class BenchmarkHistogram
+	{
+	public:
+		static constexpr size_t k_subBucketBits = 5;
+		static constexpr size_t k_subBucketCount = size_t(1) << k_subBucketBits;
+		static constexpr size_t k_bucketCount = k_subBucketCount * (64 - k_subBucketBits + 1);
+
+		static size_t BucketIndex(uint64_t value)
+		{
+			if (value < k_subBucketCount)
+				return static_cast<size_t>(value);
+
+			const size_t exponent = std::bit_width(value) - 1;
+			const size_t shift = exponent - k_subBucketBits;
+			const size_t subBucket = static_cast<size_t>(value >> shift) & (k_subBucketCount - 1);
+			return k_subBucketCount + shift * k_subBucketCount + subBucket;
+		}
+
+		static uint64_t BucketLow(size_t index)
+		{
+			if (index < k_subBucketCount)
+				return index;
+
+			const size_t shift = (index - k_subBucketCount) / k_subBucketCount;
+			const uint64_t subBucket = (index - k_subBucketCount) % k_subBucketCount;
+			return (uint64_t(1) << (shift + k_subBucketBits)) | (subBucket << shift);
+		}
+
+		static uint64_t BucketHigh(size_t index)
+		{
+			if (index < k_subBucketCount)
+				return index;
+
+			const size_t shift = (index - k_subBucketCount) / k_subBucketCount;
+			return BucketLow(index) + ((uint64_t(1) << shift) - 1);
+		}
+	};
+
+	// Written by a single thread and read concurrently by the summary writer.
+	// Relaxed load/store pairs keep the owning thread free of locked instructions.
+	class BenchmarkThreadHistogram
+	{
+	public:
+		BenchmarkThreadHistogram()
+		{
+			Reset();
+		}
+
+		// secondary: optional second total kept next to the value (ie. allocation count next to bytes)
+		void Record(uint64_t value, uint64_t weight = 1, uint64_t secondary = 0)
+		{
+			Bump(m_buckets[BenchmarkHistogram::BucketIndex(value)], weight);
+			Bump(m_count, weight);
+			Bump(m_total, value * weight);
+			if (secondary != 0)
+				Bump(m_secondary, secondary * weight);
+
+			if (value < m_min.load(std::memory_order_relaxed))
+				m_min.store(value, std::memory_order_relaxed);
+			if (value > m_max.load(std::memory_order_relaxed))
+				m_max.store(value, std::memory_order_relaxed);
+		}
+
+		void Reset()
+		{
+			for (std::atomic<uint64_t>& bucket : m_buckets)
+				bucket.store(0, std::memory_order_relaxed);
+
+			m_count.store(0, std::memory_order_relaxed);
+			m_total.store(0, std::memory_order_relaxed);
+			m_secondary.store(0, std::memory_order_relaxed);
+			m_min.store(UINT64_MAX, std::memory_order_relaxed);
+			m_max.store(0, std::memory_order_relaxed);
+		}
+
+		uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+		uint64_t Total() const { return m_total.load(std::memory_order_relaxed); }
+		uint64_t Secondary() const { return m_secondary.load(std::memory_order_relaxed); }
+		uint64_t Min() const { return m_min.load(std::memory_order_relaxed); }
+		uint64_t Max() const { return m_max.load(std::memory_order_relaxed); }
+		uint64_t Bucket(size_t index) const { return m_buckets[index].load(std::memory_order_relaxed); }
+
+	private:
+		static void Bump(std::atomic<uint64_t>& counter, uint64_t amount)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+
+		std::atomic<uint64_t> m_count;
+		std::atomic<uint64_t> m_total;
+		std::atomic<uint64_t> m_secondary;
+		std::atomic<uint64_t> m_min;
+		std::atomic<uint64_t> m_max;
+		std::atomic<uint64_t> m_buckets[BenchmarkHistogram::k_bucketCount];
+	};
+
+	// Merged view of one or more thread histograms
+	struct BenchmarkStats
+	{
+		uint64_t Count = 0;
+		uint64_t Total = 0;
+		uint64_t Secondary = 0;
+		uint64_t Min = UINT64_MAX;
+		uint64_t Max = 0;
+		std::vector<uint64_t> Buckets;
+
+		void Merge(const BenchmarkThreadHistogram& histogram)
+		{
+			const uint64_t count = histogram.Count();
+			if (count == 0)
+				return;
+
+			if (Buckets.empty())
+				Buckets.resize(BenchmarkHistogram::k_bucketCount);
+
+			for (size_t i = 0; i < BenchmarkHistogram::k_bucketCount; ++i)
+				Buckets[i] += histogram.Bucket(i);
+
+			Count += count;
+			Total += histogram.Total();
+			Secondary += histogram.Secondary();
+			Min = std::min(Min, histogram.Min());
+			Max = std::max(Max, histogram.Max());
+		}
+
+		void Merge(const BenchmarkStats& other)
+		{
+			if (other.Count == 0)
+				return;
+
+			if (Buckets.empty())
+				Buckets.resize(BenchmarkHistogram::k_bucketCount);
+
+			for (size_t i = 0; i < BenchmarkHistogram::k_bucketCount; ++i)
+				Buckets[i] += other.Buckets[i];
+
+			Count += other.Count;
+			Total += other.Total;
+			Secondary += other.Secondary;
+			Min = std::min(Min, other.Min);
+			Max = std::max(Max, other.Max);
+		}
+
+		double Mean() const
+		{
+			return (Count == 0) ? 0.0 : static_cast<double>(Total) / static_cast<double>(Count);
+		}
+
+		// percentile in [0, 1]. Returns the midpoint of the bucket holding that rank, clamped to [Min, Max].
+		uint64_t Percentile(double percentile) const
+		{
+			if (Count == 0)
+				return 0;
+
+			const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile * static_cast<double>(Count) + 0.5));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < Buckets.size(); ++i)
+			{
+				seen += Buckets[i];
+				if (seen >= rank)
+				{
+					const uint64_t low = BenchmarkHistogram::BucketLow(i);
+					const uint64_t mid = low + (BenchmarkHistogram::BucketHigh(i) - low) / 2;
+					return std::clamp(mid, Min, Max);
+				}
+			}
+			return Max;
+		}
+	};
+}
+
+#endif // !XE_BENCHMARKSTATS_H
@@ -0,0 +1,629 @@
+/*========================================================
+
+ XephTools - Benchmark Trace
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Binary trace layout (all integers are 7-bit varints, as written by BinaryWriter::WriteSizeValue):
+	  Header:  "XETR" | version | nanoseconds per tick | session name
+	  Site:    0x01 | site id | type | name | file | line | function | sample rate | rate limit
+	  Events:  0x02 | thread id | count | count * (site id | zigzag start delta | payload [| weight])
+	  End:     0xFF | dropped event count
+  - Start deltas are relative to the previous event of the same thread.
+  - Site records are written once per session, before the first event that uses them.
+  - The payload depends on the site type: Complete = duration, Counter = 8 byte little-endian double,
+	Instant = nothing, Flow* = flow id, Allocation = allocation count | bytes.
+  - Events of sampled sites (sample rate != 1 or rate limit != 0) also store their weight:
+	the number of invocations the event stands for.
+
+========================================================*/
+
+#ifndef XE_BENCHMARKTRACE_H
+#define XE_BENCHMARKTRACE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xe
+{
+	enum class ProfileType : uint8_t
+	{
+		Complete,  // Timed scope
+		Counter,   // Sampled value (queue depth, memory usage, ...)
+		Instant,   // Point in time (state change)
+		FlowBegin, // Start of work handed between threads, linked by flow id
+		FlowStep,
+		FlowEnd,
+		Allocation, // Heap allocations made inside a scope (see XEBenchmarkAllocationHooks)
+	};
+
+	inline bool IsFlow(ProfileType type)
+	{
+		return type == ProfileType::FlowBegin || type == ProfileType::FlowStep || type == ProfileType::FlowEnd;
+	}
+
+	// Call site of a benchmark scope. Registered once per site and referenced by ID from every event.
+	struct BenchmarkSite
+	{
+		std::string Name;
+		std::string File;
+		uint32_t Line = 0;
+		std::string Function;
+		ProfileType Type = ProfileType::Complete;
+		uint32_t SampleRate = 1; // Records 1 in SampleRate invocations
+		uint32_t RateLimit = 0;  // Records at most RateLimit invocations per second per thread, 0 for no limit
+
+		bool IsSampled() const
+		{
+			return SampleRate != 1 || RateLimit != 0;
+		}
+	};
+
+	struct AllocationStats
+	{
+		uint32_t Count;
+		uint32_t Bytes; // Saturates at 4 GiB
+	};
+
+	struct ProfileResult
+	{
+		uint16_t SiteID;
+		ProfileType Type;
+		uint32_t Weight; // Number of invocations this event represents (> 1 for sampled sites)
+		long long Start;
+		union
+		{
+			long long End;   // Complete
+			double Value;    // Counter
+			uint64_t FlowID; // Flow*
+			AllocationStats Allocations; // Allocation
+		};
+	};
+
+	enum class TraceFormat
+	{
+		Json,
+		Binary,
+	};
+
+	class TraceWriter
+	{
+	public:
+		virtual ~TraceWriter() = default;
+
+		virtual void WriteHeader(const std::string& sessionName, uint32_t nsPerTick) = 0;
+		virtual void WriteSite(uint16_t siteID, const BenchmarkSite& site) = 0;
+		virtual void WriteEvents(uint32_t threadID, const ProfileResult* events, size_t count) = 0;
+		virtual void WriteFooter(size_t droppedCount) = 0;
+		virtual void Flush() = 0;
+	};
+
+	class JsonTraceWriter : public TraceWriter
+	{
+	public:
+		JsonTraceWriter(std::ostream& stream) : m_stream(stream) {}
+
+		void WriteHeader(const std::string& sessionName, uint32_t nsPerTick) override
+		{
+			m_nsPerTick = nsPerTick;
+			m_stream << "{\"traceEvents\":[";
+			m_stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":";
+			WriteString(sessionName);
+			m_stream << "}}";
+		}
+
+		void WriteSite(uint16_t siteID, const BenchmarkSite& site) override
+		{
+			if (siteID >= m_sites.size())
+				m_sites.resize(siteID + 1);
+
+			m_sites[siteID] = site;
+			m_sites[siteID].Name = Escape(site.Name);
+		}
+
+		void WriteEvents(uint32_t threadID, const ProfileResult* events, size_t count) override
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				const ProfileResult& result = events[i];
+
+				m_stream << ",{";
+				m_stream << "\"name\":\"" << SiteName(result.SiteID) << "\",";
+				switch (result.Type)
+				{
+				case ProfileType::Complete:
+					m_stream << "\"cat\":\"function\",\"ph\":\"X\",\"dur\":";
+					WriteTime((result.End > result.Start) ? result.End - result.Start : 0);
+					m_stream << ",";
+					break;
+				case ProfileType::Counter:
+					m_stream << "\"cat\":\"counter\",\"ph\":\"C\",\"args\":{\"value\":" << result.Value << "},";
+					break;
+				case ProfileType::Instant:
+					m_stream << "\"cat\":\"instant\",\"ph\":\"i\",\"s\":\"t\",";
+					break;
+				case ProfileType::FlowBegin:
+					m_stream << "\"cat\":\"flow\",\"ph\":\"s\",\"id\":" << result.FlowID << ",";
+					break;
+				case ProfileType::FlowStep:
+					m_stream << "\"cat\":\"flow\",\"ph\":\"t\",\"id\":" << result.FlowID << ",";
+					break;
+				case ProfileType::FlowEnd:
+					m_stream << "\"cat\":\"flow\",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << result.FlowID << ",";
+					break;
+				case ProfileType::Allocation:
+					m_stream << "\"cat\":\"allocation\",\"ph\":\"C\",\"args\":{\"count\":" << result.Allocations.Count << ",\"bytes\":" << result.Allocations.Bytes;
+					if (result.Weight != 1)
+						m_stream << ",\"weight\":" << result.Weight;
+					m_stream << "},";
+					break;
+				}
+				m_stream << "\"pid\":0,";
+				m_stream << "\"tid\":" << threadID << ",";
+				m_stream << "\"ts\":";
+				WriteTime(result.Start);
+				if (result.Weight != 1 && result.Type != ProfileType::Counter && result.Type != ProfileType::Allocation)
+					m_stream << ",\"args\":{\"weight\":" << result.Weight << "}";
+				m_stream << "}";
+			}
+		}
+
+		void WriteFooter(size_t droppedCount) override
+		{
+			m_stream << "],\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":" << droppedCount << ",\"sites\":[";
+			for (size_t i = 0; i < m_sites.size(); ++i)
+			{
+				const BenchmarkSite& site = m_sites[i];
+				if (i > 0)
+					m_stream << ",";
+				m_stream << "{\"id\":" << i << ",\"name\":\"" << site.Name << "\",\"file\":";
+				WriteString(site.File);
+				m_stream << ",\"line\":" << site.Line << ",\"function\":";
+				WriteString(site.Function);
+				m_stream << ",\"type\":" << static_cast<int>(site.Type) << ",\"sampleRate\":" << site.SampleRate << ",\"rateLimit\":" << site.RateLimit << "}";
+			}
+			m_stream << "]}}";
+			m_stream.flush();
+		}
+
+		void Flush() override
+		{
+			m_stream.flush();
+		}
+
+	private:
+		// chrome://tracing expects microseconds
+		void WriteTime(long long ticks)
+		{
+			if (m_nsPerTick % 1000 == 0)
+			{
+				m_stream << ticks * (m_nsPerTick / 1000);
+				return;
+			}
+
+			long long ns = ticks * m_nsPerTick;
+			long long fraction = ns % 1000;
+			if (fraction < 0)
+			{
+				m_stream << '-';
+				ns = -ns;
+				fraction = -fraction;
+			}
+			m_stream << ns / 1000 << '.' << static_cast<char>('0' + fraction / 100) << static_cast<char>('0' + fraction / 10 % 10) << static_cast<char>('0' + fraction % 10);
+		}
+
+		const std::string& SiteName(uint16_t siteID) const
+		{
+			static const std::string unknown = "<unknown>";
+			return (siteID < m_sites.size()) ? m_sites[siteID].Name : unknown;
+		}
+
+		void WriteString(const std::string& str)
+		{
+			m_stream << '"' << Escape(str) << '"';
+		}
+
+		static std::string Escape(const std::string& str)
+		{
+			std::string result;
+			result.reserve(str.length());
+			for (const char c : str)
+			{
+				if (c == '"')
+					result.push_back('\'');
+				else if (c == '\\')
+					result.append("\\\\");
+				else if (static_cast<unsigned char>(c) < 0x20)
+					result.push_back(' ');
+				else
+					result.push_back(c);
+			}
+			return result;
+		}
+
+		std::ostream& m_stream;
+		std::vector<BenchmarkSite> m_sites;
+		uint32_t m_nsPerTick = 1000;
+	};
+
+	class BinaryTraceWriter : public TraceWriter
+	{
+	public:
+		static constexpr char k_magic[4] = { 'X', 'E', 'T', 'R' };
+		static constexpr uint8_t k_version = 5;
+		static constexpr uint8_t k_recordSite = 0x01;
+		static constexpr uint8_t k_recordEvents = 0x02;
+		static constexpr uint8_t k_recordEnd = 0xFF;
+
+		BinaryTraceWriter(std::ostream& stream) : m_stream(stream) {}
+
+		void WriteHeader(const std::string& sessionName, uint32_t nsPerTick) override
+		{
+			m_buffer.insert(m_buffer.end(), k_magic, k_magic + sizeof(k_magic));
+			WriteVarint(k_version);
+			WriteVarint(nsPerTick);
+			WriteString(sessionName);
+			Commit();
+		}
+
+		void WriteSite(uint16_t siteID, const BenchmarkSite& site) override
+		{
+			m_buffer.push_back(k_recordSite);
+			WriteVarint(siteID);
+			WriteVarint(static_cast<uint8_t>(site.Type));
+			WriteString(site.Name);
+			WriteString(site.File);
+			WriteVarint(site.Line);
+			WriteString(site.Function);
+			WriteVarint(site.SampleRate);
+			WriteVarint(site.RateLimit);
+			Commit();
+
+			if (siteID >= m_sites.size())
+				m_sites.resize(siteID + 1);
+			m_sites[siteID] = { site.Type, site.IsSampled() };
+		}
+
+		void WriteEvents(uint32_t threadID, const ProfileResult* events, size_t count) override
+		{
+			if (count == 0)
+				return;
+
+			long long& lastStart = m_lastStart[threadID];
+
+			m_buffer.push_back(k_recordEvents);
+			WriteVarint(threadID);
+			WriteVarint(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const ProfileResult& result = events[i];
+				const SiteLayout layout = (result.SiteID < m_sites.size()) ? m_sites[result.SiteID] : SiteLayout();
+
+				WriteVarint(result.SiteID);
+				WriteVarint(ZigZag(result.Start - lastStart));
+				switch (layout.Type)
+				{
+				case ProfileType::Complete:
+					// A scope that spans a clock recalibration can end a few ns before it started
+					WriteVarint((result.End > result.Start) ? static_cast<uint64_t>(result.End - result.Start) : 0);
+					break;
+				case ProfileType::Counter:
+					WriteDouble(result.Value);
+					break;
+				case ProfileType::Instant:
+					break;
+				case ProfileType::Allocation:
+					WriteVarint(result.Allocations.Count);
+					WriteVarint(result.Allocations.Bytes);
+					break;
+				default:
+					WriteVarint(result.FlowID);
+					break;
+				}
+				if (layout.IsSampled)
+					WriteVarint(result.Weight);
+				lastStart = result.Start;
+			}
+			Commit();
+		}
+
+		void WriteFooter(size_t droppedCount) override
+		{
+			m_buffer.push_back(k_recordEnd);
+			WriteVarint(droppedCount);
+			Commit();
+			m_stream.flush();
+		}
+
+		void Flush() override
+		{
+			m_stream.flush();
+		}
+
+		// What the decoder needs to know about a site to read its events
+		struct SiteLayout
+		{
+			ProfileType Type = ProfileType::Complete;
+			bool IsSampled = false;
+		};
+
+		static uint64_t ZigZag(long long value)
+		{
+			return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+		}
+
+	private:
+		void WriteVarint(uint64_t value)
+		{
+			do
+			{
+				uint8_t byte = value & 0x7F;
+				value >>= 7;
+
+				if (value > 0)
+				{
+					byte |= 0x80;
+				}
+
+				m_buffer.push_back(byte);
+			} while (value > 0);
+		}
+
+		void WriteDouble(double value)
+		{
+			uint64_t bits = 0;
+			std::memcpy(&bits, &value, sizeof(bits));
+			for (size_t i = 0; i < sizeof(bits); ++i)
+				m_buffer.push_back(static_cast<char>((bits >> (i * 8)) & 0xFF));
+		}
+
+		void WriteString(const std::string& str)
+		{
+			WriteVarint(str.length());
+			m_buffer.insert(m_buffer.end(), str.begin(), str.end());
+		}
+
+		void Commit()
+		{
+			m_stream.write(m_buffer.data(), m_buffer.size());
+			m_buffer.clear();
+		}
+
+		std::ostream& m_stream;
+		std::vector<char> m_buffer;
+		std::vector<SiteLayout> m_sites;
+		std::unordered_map<uint32_t, long long> m_lastStart;
+	};
+
+	class BinaryTraceReader
+	{
+	public:
+		BinaryTraceReader(std::istream& stream) : m_stream(stream) {}
+
+		// Replays a binary trace into another writer. Returns false if the data is not a valid trace.
+		bool ReadInto(TraceWriter& writer)
+		{
+			char magic[sizeof(BinaryTraceWriter::k_magic)];
+			if (!m_stream.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), BinaryTraceWriter::k_magic))
+				return false;
+
+			uint64_t version = 0, nsPerTick = 0;
+			std::string sessionName;
+			if (!ReadVarint(version) || version != BinaryTraceWriter::k_version || !ReadVarint(nsPerTick) || !ReadString(sessionName))
+				return false;
+
+			writer.WriteHeader(sessionName, static_cast<uint32_t>(nsPerTick));
+
+			std::vector<ProfileResult> events;
+			while (true)
+			{
+				const int record = m_stream.get();
+				if (record == std::char_traits<char>::eof())
+				{
+					// Session was never ended (ie. the app crashed). Keep what we have.
+					writer.WriteFooter(0);
+					return true;
+				}
+
+				switch (static_cast<uint8_t>(record))
+				{
+				case BinaryTraceWriter::k_recordSite:
+				{
+					uint64_t siteID = 0, type = 0, line = 0, sampleRate = 0, rateLimit = 0;
+					BenchmarkSite site;
+					if (!ReadVarint(siteID) || !ReadVarint(type) || !ReadString(site.Name) || !ReadString(site.File) || !ReadVarint(line) || !ReadString(site.Function)
+						|| !ReadVarint(sampleRate) || !ReadVarint(rateLimit) || siteID > UINT16_MAX)
+						return false;
+
+					if (type > static_cast<uint8_t>(ProfileType::Allocation))
+						return false;
+
+					site.Type = static_cast<ProfileType>(type);
+					site.Line = static_cast<uint32_t>(line);
+					site.SampleRate = static_cast<uint32_t>(sampleRate);
+					site.RateLimit = static_cast<uint32_t>(rateLimit);
+					// The writer numbers sites in order, so a new site is always the next ID
+					if (siteID > m_sites.size())
+						return false;
+					if (siteID == m_sites.size())
+						m_sites.emplace_back();
+					m_sites[siteID] = { site.Type, site.IsSampled() };
+
+					writer.WriteSite(static_cast<uint16_t>(siteID), site);
+					break;
+				}
+				case BinaryTraceWriter::k_recordEvents:
+				{
+					uint64_t threadID = 0, count = 0;
+					if (!ReadVarint(threadID) || !ReadVarint(count))
+						return false;
+
+					long long& lastStart = m_lastStart[static_cast<uint32_t>(threadID)];
+					// count comes from the file, so memory only grows with the events actually read
+					events.clear();
+					events.reserve(static_cast<size_t>(std::min<uint64_t>(count, k_maxReserve)));
+					for (uint64_t i = 0; i < count; ++i)
+					{
+						ProfileResult& result = events.emplace_back();
+						uint64_t siteID = 0, delta = 0;
+						if (!ReadVarint(siteID) || !ReadVarint(delta) || siteID > UINT16_MAX)
+							return false;
+
+						const BinaryTraceWriter::SiteLayout layout = (siteID < m_sites.size()) ? m_sites[siteID] : BinaryTraceWriter::SiteLayout();
+						result.SiteID = static_cast<uint16_t>(siteID);
+						result.Type = layout.Type;
+						result.Start = lastStart + UnZigZag(delta);
+						lastStart = result.Start;
+
+						switch (layout.Type)
+						{
+						case ProfileType::Complete:
+						{
+							uint64_t duration = 0;
+							if (!ReadVarint(duration))
+								return false;
+							result.End = result.Start + static_cast<long long>(duration);
+							break;
+						}
+						case ProfileType::Counter:
+							if (!ReadDouble(result.Value))
+								return false;
+							break;
+						case ProfileType::Instant:
+							result.End = result.Start;
+							break;
+						case ProfileType::Allocation:
+						{
+							uint64_t count = 0, bytes = 0;
+							if (!ReadVarint(count) || !ReadVarint(bytes))
+								return false;
+							result.Allocations = { static_cast<uint32_t>(count), static_cast<uint32_t>(bytes) };
+							break;
+						}
+						default:
+							if (!ReadVarint(result.FlowID))
+								return false;
+							break;
+						}
+
+						uint64_t weight = 1;
+						if (layout.IsSampled && !ReadVarint(weight))
+							return false;
+						result.Weight = static_cast<uint32_t>(weight);
+					}
+					writer.WriteEvents(static_cast<uint32_t>(threadID), events.data(), events.size());
+					break;
+				}
+				case BinaryTraceWriter::k_recordEnd:
+				{
+					uint64_t dropped = 0;
+					if (!ReadVarint(dropped))
+						return false;
+
+					writer.WriteFooter(dropped);
+					return true;
+				}
+				default:
+					return false;
+				}
+			}
+		}
+
+		static long long UnZigZag(uint64_t value)
+		{
+			return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+		}
+
+	private:
+		// Sizes read from the file are checked against these before anything is allocated, so a
+		// truncated or corrupt trace returns false instead of throwing or allocating gigabytes
+		static constexpr size_t k_maxStringLength = 1 << 20;
+		static constexpr size_t k_maxReserve = 8192;
+
+		bool ReadVarint(uint64_t& result)
+		{
+			result = 0;
+			size_t shift = 0;
+			int byte = 0;
+
+			do
+			{
+				byte = m_stream.get();
+				if (byte == std::char_traits<char>::eof() || shift >= 64)
+					return false;
+
+				result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				shift += 7;
+			} while (byte & 0x80);
+			return true;
+		}
+
+		bool ReadDouble(double& result)
+		{
+			unsigned char bytes[sizeof(uint64_t)];
+			if (!m_stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+				return false;
+
+			uint64_t bits = 0;
+			for (size_t i = 0; i < sizeof(bits); ++i)
+				bits |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+			std::memcpy(&result, &bits, sizeof(result));
+			return true;
+		}
+
+		bool ReadString(std::string& result)
+		{
+			uint64_t length = 0;
+			if (!ReadVarint(length) || length > k_maxStringLength)
+				return false;
+
+			result.resize(static_cast<size_t>(length));
+			return static_cast<bool>(m_stream.read(result.data(), length));
+		}
+
+		std::istream& m_stream;
+		std::vector<BinaryTraceWriter::SiteLayout> m_sites;
+		std::unordered_map<uint32_t, long long> m_lastStart;
+	};
+
+	// Converts a binary trace into chrome://tracing / Perfetto compatible JSON
+	inline bool ConvertTraceToJson(const std::filesystem::path& input, const std::filesystem::path& output)
+	{
+		std::ifstream inFile(input, std::ios::binary);
+		if (!inFile.is_open())
+			return false;
+
+		std::ofstream outFile(output);
+		if (!outFile.is_open())
+			return false;
+
+		JsonTraceWriter writer(outFile);
+		return BinaryTraceReader(inFile).ReadInto(writer);
+	}
+}
+
+#endif // !XE_BENCHMARKTRACE_H
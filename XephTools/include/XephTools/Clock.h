@@ -0,0 +1,337 @@
+/*========================================================
+
+ XephTools - Clock
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - A clock policy provides `static int64_t Now()` (nanoseconds) and `static void Calibrate()`.
+  - TscClock reads the CPU timestamp counter and falls back to SteadyClock when the TSC is
+	not invariant (or on non x86-64 targets). Both report nanoseconds on the steady_clock epoch.
+  - TscClock calibrates without blocking: it reads steady_clock for the first 10 ms, then
+	switches to the TSC rate measured over that window, refined once more after a second.
+	Each new rate starts where the previous one left off, so time never jumps at a recalibration.
+  - Define XE_DEFAULT_CLOCK before including to change the clock used by xe::Timer and Benchmark.
+
+========================================================*/
+
+#ifndef XE_CLOCK_H
+#define XE_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define XE_CLOCK_HAS_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif // _MSC_VER
+#endif // x86-64
+
+namespace xe
+{
+	struct SteadyClock
+	{
+		static int64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		static void Calibrate() {}
+	};
+
+	class TscClock
+	{
+	public:
+		static int64_t Now()
+		{
+#ifdef XE_CLOCK_HAS_TSC
+			if (IsInvariant())
+				return FromTicks(__rdtsc());
+#endif // XE_CLOCK_HAS_TSC
+			return SteadyClock::Now();
+		}
+
+		// rdtscp waits for earlier instructions to finish, use when the end of a measurement must not be reordered
+		static int64_t NowSerialized()
+		{
+#ifdef XE_CLOCK_HAS_TSC
+			if (IsInvariant())
+			{
+				unsigned int aux;
+				return FromTicks(__rdtscp(&aux));
+			}
+#endif // XE_CLOCK_HAS_TSC
+			return SteadyClock::Now();
+		}
+
+		static bool IsInvariant()
+		{
+			static const bool isInvariant = QueryInvariant();
+			return isInvariant;
+		}
+
+		// Measures the TSC rate against steady_clock for `duration` (blocking) and uses it right away
+		static void Calibrate(std::chrono::milliseconds duration)
+		{
+#ifdef XE_CLOCK_HAS_TSC
+			if (!IsInvariant())
+				return;
+
+			State& state = GetState();
+			uint64_t startTicks, endTicks;
+			int64_t startNs, endNs;
+			SamplePair(startTicks, startNs);
+			std::this_thread::sleep_for(duration);
+			SamplePair(endTicks, endNs);
+			if (endTicks <= startTicks)
+				return;
+
+			std::lock_guard<std::mutex> lock(state.Mutex);
+			Publish(state, endTicks, endNs, static_cast<double>(endNs - startNs) / static_cast<double>(endTicks - startTicks));
+			state.Pending.store(false, std::memory_order_relaxed);
+#else
+			(void)duration;
+#endif // XE_CLOCK_HAS_TSC
+		}
+
+		// Measures the rate again over a second without blocking (ie. at session start, to correct drift).
+		// The current rate is kept until then, and Now() swaps in the new one.
+		static void Calibrate()
+		{
+#ifdef XE_CLOCK_HAS_TSC
+			if (!IsInvariant())
+				return;
+
+			State& state = GetState();
+			std::lock_guard<std::mutex> lock(state.Mutex);
+			Restart(state);
+#endif // XE_CLOCK_HAS_TSC
+		}
+
+	private:
+		// Until the first window has passed Now() reads steady_clock. The rate is then refined once over a longer window.
+		static const int64_t k_firstWindowNs = 10'000'000;
+		static const int64_t k_refineWindowNs = 1'000'000'000;
+
+		struct Calibration
+		{
+			uint64_t BaseTicks = 0;
+			int64_t BaseNs = 0;
+			double NsPerTick = 0.0;
+
+			int64_t ToNanoseconds(uint64_t ticks) const
+			{
+				return BaseNs + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(ticks - BaseTicks)) * NsPerTick);
+			}
+		};
+
+		// The calibration is a seqlock: an odd Sequence means a write is in progress, and readers retry.
+		// Writes are three stores under Mutex, so a reader only waits if the writer is preempted mid-way.
+		struct State
+		{
+			State()
+			{
+				Restart(*this);
+			}
+
+			std::atomic<uint32_t> Sequence = 0;
+			std::atomic<uint64_t> BaseTicks = 0;
+			std::atomic<int64_t> BaseNs = 0;
+			std::atomic<double> NsPerTick = 0.0; // 0 until the first window has passed
+
+			// Measurement in progress. Mutex is only taken to start or finish one, never on the Now() fast path.
+			std::mutex Mutex;
+			std::atomic<bool> Pending = false;
+			std::atomic<int64_t> AnchorNs = 0;
+			std::atomic<int64_t> WindowNs = 0;
+			uint64_t AnchorTicks = 0;
+		};
+
+		static State& GetState()
+		{
+			static State state;
+			return state;
+		}
+
+#ifdef XE_CLOCK_HAS_TSC
+		static int64_t FromTicks(uint64_t ticks)
+		{
+			State& state = GetState();
+			Calibration calibration;
+			if (!Read(state, calibration))
+			{
+				const int64_t now = SteadyClock::Now();
+				if (now - state.AnchorNs.load(std::memory_order_relaxed) >= state.WindowNs.load(std::memory_order_relaxed))
+					TryFinish(state);
+				return now;
+			}
+
+			const int64_t now = calibration.ToNanoseconds(ticks);
+			if (state.Pending.load(std::memory_order_relaxed)
+				&& now - state.AnchorNs.load(std::memory_order_relaxed) >= state.WindowNs.load(std::memory_order_relaxed))
+			{
+				TryFinish(state);
+			}
+			return now;
+		}
+#endif // XE_CLOCK_HAS_TSC
+
+		// False while uncalibrated. Falling back to steady_clock during a write would not agree with the TSC line.
+		static bool Read(const State& state, Calibration& calibration)
+		{
+			for (uint32_t attempt = 0;; ++attempt)
+			{
+				const uint32_t sequence = state.Sequence.load(std::memory_order_acquire);
+				if ((sequence & 1) == 0)
+				{
+					calibration.BaseTicks = state.BaseTicks.load(std::memory_order_relaxed);
+					calibration.BaseNs = state.BaseNs.load(std::memory_order_relaxed);
+					calibration.NsPerTick = state.NsPerTick.load(std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (state.Sequence.load(std::memory_order_relaxed) == sequence)
+						return calibration.NsPerTick != 0.0;
+				}
+
+				if (attempt >= 16)
+					std::this_thread::yield(); // The writer was preempted mid-write
+			}
+		}
+
+		// Caller holds state.Mutex. `ns` is the steady_clock time at `ticks`, only used for the first calibration:
+		// after that the new rate starts from the current line's value at `ticks`, so time stays continuous.
+		static void Publish(State& state, uint64_t ticks, int64_t ns, double nsPerTick)
+		{
+			const double current = state.NsPerTick.load(std::memory_order_relaxed);
+			if (current != 0.0)
+			{
+				const Calibration previous{ state.BaseTicks.load(std::memory_order_relaxed), state.BaseNs.load(std::memory_order_relaxed), current };
+				ns = previous.ToNanoseconds(ticks);
+			}
+
+			const uint32_t sequence = state.Sequence.load(std::memory_order_relaxed);
+			state.Sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			state.BaseTicks.store(ticks, std::memory_order_relaxed);
+			state.BaseNs.store(ns, std::memory_order_relaxed);
+			state.NsPerTick.store(nsPerTick, std::memory_order_relaxed);
+			state.Sequence.store(sequence + 2, std::memory_order_release);
+		}
+
+		// Caller holds state.Mutex (or is the State constructor)
+		static void Restart(State& state)
+		{
+#ifdef XE_CLOCK_HAS_TSC
+			int64_t anchorNs;
+			SamplePair(state.AnchorTicks, anchorNs);
+			state.AnchorNs.store(anchorNs, std::memory_order_relaxed);
+			// Once calibrated, keep the current rate and only take the longer measurement
+			const bool isCalibrated = state.NsPerTick.load(std::memory_order_relaxed) != 0.0;
+			state.WindowNs.store(isCalibrated ? k_refineWindowNs : k_firstWindowNs, std::memory_order_relaxed);
+			state.Pending.store(true, std::memory_order_relaxed);
+#else
+			(void)state;
+#endif // XE_CLOCK_HAS_TSC
+		}
+
+#ifdef XE_CLOCK_HAS_TSC
+		// A TSC reading taken at the same moment as a steady_clock reading. Keeps the tightest of a few tries,
+		// so a thread preempted between the two reads does not skew the calibration by a time slice.
+		static void SamplePair(uint64_t& ticks, int64_t& ns)
+		{
+			uint64_t best = UINT64_MAX;
+			ticks = 0;
+			ns = 0;
+			for (int i = 0; i < 4; ++i)
+			{
+				const uint64_t before = __rdtsc();
+				const int64_t steady = SteadyClock::Now();
+				const uint64_t after = __rdtsc();
+				if (after - before < best)
+				{
+					best = after - before;
+					ticks = before + (after - before) / 2;
+					ns = steady;
+				}
+			}
+		}
+
+		// Called from Now() once the window has passed. Whoever gets the lock publishes; everyone else moves on.
+		static void TryFinish(State& state)
+		{
+			std::unique_lock<std::mutex> lock(state.Mutex, std::try_to_lock);
+			if (!lock.owns_lock() || !state.Pending.load(std::memory_order_relaxed))
+				return;
+
+			uint64_t ticks;
+			int64_t ns;
+			SamplePair(ticks, ns);
+			const int64_t elapsedNs = ns - state.AnchorNs.load(std::memory_order_relaxed);
+			const int64_t windowNs = state.WindowNs.load(std::memory_order_relaxed);
+			if (elapsedNs < windowNs || ticks <= state.AnchorTicks)
+				return;
+
+			Publish(state, ticks, ns, static_cast<double>(elapsedNs) / static_cast<double>(ticks - state.AnchorTicks));
+			if (windowNs < k_refineWindowNs)
+				state.WindowNs.store(k_refineWindowNs, std::memory_order_relaxed); // Same anchor, longer baseline
+			else
+				state.Pending.store(false, std::memory_order_relaxed);
+		}
+#endif // XE_CLOCK_HAS_TSC
+
+		static bool QueryInvariant()
+		{
+#ifdef XE_CLOCK_HAS_TSC
+			// CPUID 0x80000007 EDX bit 8: TSC runs at a constant rate in all P/C states
+#ifdef _MSC_VER
+			int info[4] = {};
+			__cpuid(info, 0x80000000);
+			if (static_cast<unsigned int>(info[0]) < 0x80000007)
+				return false;
+			__cpuid(info, 0x80000007);
+			return (info[3] & (1 << 8)) != 0;
+#else
+			unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+			if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+				return false;
+			__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+			return (edx & (1 << 8)) != 0;
+#endif // _MSC_VER
+#else
+			return false;
+#endif // XE_CLOCK_HAS_TSC
+		}
+	};
+
+#ifdef XE_DEFAULT_CLOCK
+	using DefaultClock = XE_DEFAULT_CLOCK;
+#elif defined(XE_CLOCK_HAS_TSC)
+	using DefaultClock = TscClock;
+#else
+	using DefaultClock = SteadyClock;
+#endif // XE_DEFAULT_CLOCK
+}
+
+#endif // !XE_CLOCK_H
@@ -1,12 +1,33 @@
 #pragma once
 
+#include "Clock.h"
+
+#include <cstddef>
+#include <concepts>
+#include <cstdint>
 #include <functional>
-#include <vector>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #ifndef XE_UNDOREDOSTACK_DEFAULT_SIZE
 #define XE_UNDOREDOSTACK_DEFAULT_SIZE 50
 #endif // XE_UNDOREDOSTACK_DEFAULT_SIZE
 
+#ifndef XE_COMMANDSTACK_MERGE_WINDOW
+#define XE_COMMANDSTACK_MERGE_WINDOW 0.5f
+#endif // XE_COMMANDSTACK_MERGE_WINDOW
+
+#ifndef XE_COMMANDSTACK_BYTE_BUDGET
+#define XE_COMMANDSTACK_BYTE_BUDGET 0 // No limit
+#endif // XE_COMMANDSTACK_BYTE_BUDGET
+
+#ifndef XE_COMMANDSTACK_ARENA_SIZE
+#define XE_COMMANDSTACK_ARENA_SIZE (64 * 1024)
+#endif // XE_COMMANDSTACK_ARENA_SIZE
+
 namespace xe
 {
 	struct Command
@@ -15,112 +36,637 @@ namespace xe
 		std::function<void(void)> revert;
 	};
 
+	// How CommandStack calls a stored command. Command types provide `void Execute()` and `void Revert()`.
+	// Optionally `bool MergeWith(const T& next)`: called with a command of the same type that was just
+	// executed. Return true after folding it into this one (ie. same target) to keep it off the stack.
+	// Optionally `size_t ByteSize() const`: memory held by the command, counted against the byte budget.
+	// Read after Execute and after every merge. Defaults to sizeof(T).
+	// Optionally `void Spill()`: move the command's data out of memory (ie. to disk). Called by
+	// CommandStack::SpillOlderThan; the command must still Execute and Revert afterwards.
+	template <typename T>
+	struct CommandTraits
+	{
+		static constexpr bool k_canMerge = requires(T& top, const T& next) { { top.MergeWith(next) } -> std::convertible_to<bool>; };
+		static constexpr bool k_canSpill = requires(T& command) { command.Spill(); };
+
+		static void Execute(T& command) { command.Execute(); }
+		static void Revert(T& command) { command.Revert(); }
+
+		static bool Merge(T& top, const T& next)
+		{
+			if constexpr (k_canMerge)
+				return top.MergeWith(next);
+			else
+				return false;
+		}
+
+		static size_t ByteSize(const T& command)
+		{
+			if constexpr (requires { { command.ByteSize() } -> std::convertible_to<size_t>; })
+				return command.ByteSize();
+			else
+				return sizeof(T);
+		}
+
+		static void Spill(T& command)
+		{
+			if constexpr (k_canSpill)
+				command.Spill();
+		}
+	};
+
+	template <>
+	struct CommandTraits<Command>
+	{
+		static constexpr bool k_canMerge = false;
+		static constexpr bool k_canSpill = false;
+
+		static void Execute(Command& command) { command.execute(); }
+		static void Revert(Command& command) { command.revert(); }
+		static bool Merge(Command&, const Command&) { return false; }
+		static size_t ByteSize(const Command&) { return sizeof(Command); }
+		static void Spill(Command&) {}
+	};
+
+	// Stores the two callables of PushAndExecute(execute, revert) as they are, without std::function
+	template <typename ExecuteFunc, typename RevertFunc>
+	struct FunctionCommand
+	{
+		ExecuteFunc OnExecute;
+		RevertFunc OnRevert;
+
+		void Execute() { OnExecute(); }
+		void Revert() { OnRevert(); }
+	};
+
+	// Commands are constructed in place in a ring-buffer arena that is allocated once, and destroyed
+	// in place when they are discarded (redo history cut off) or pushed off the bottom.
+	// Holds at most `size` commands and `arenaBytes` bytes of command objects, whichever runs out first.
+	// With a byte budget set, the oldest commands are also evicted while the reported sizes exceed it.
 	class CommandStack
 	{
 	private:
-		static const size_t k_undefined = SIZE_MAX;
-	
+		static const size_t k_alignment = alignof(std::max_align_t);
+
+		struct Ops
+		{
+			void (*Execute)(void* command);
+			void (*Revert)(void* command);
+			void (*Destroy)(void* command);
+			size_t (*ByteSize)(const void* command);
+			void (*Spill)(void* command); // nullptr if the type cannot spill
+		};
+
+		// Sits in front of every command in the arena. Size includes the header.
+		struct alignas(k_alignment) RecordHeader
+		{
+			const Ops* Operations;
+			uint32_t Size;
+		};
+
+		struct RecordSlot
+		{
+			uint32_t Offset; // Of the RecordHeader in the arena
+			bool Joined; // Undone and redone together with the command below it (same transaction)
+			size_t Bytes; // ByteSize() when last measured
+		};
+
+		// Closes a transaction that has an after-batch callback. Called by Undo/Redo, not by Ops.
+		struct TransactionEnd
+		{
+			std::function<void(void)> AfterBatch;
+
+			void Execute() {}
+			void Revert() {}
+		};
+
+		template <typename T>
+		static constexpr Ops k_ops =
+		{
+			[](void* command) { CommandTraits<T>::Execute(*static_cast<T*>(command)); },
+			[](void* command) { CommandTraits<T>::Revert(*static_cast<T*>(command)); },
+			[](void* command) { static_cast<T*>(command)->~T(); },
+			[](const void* command) { return CommandTraits<T>::ByteSize(*static_cast<const T*>(command)); },
+			CommandTraits<T>::k_canSpill ? +[](void* command) { CommandTraits<T>::Spill(*static_cast<T*>(command)); } : nullptr,
+		};
+
 	public:
-		CommandStack(size_t size)
+		CommandStack(size_t size, size_t arenaBytes = XE_COMMANDSTACK_ARENA_SIZE)
+			: m_maxCommands(size)
+			, m_arenaSize(arenaBytes / k_alignment * k_alignment)
+			, m_arena(new std::byte[m_arenaSize])
+			, m_records(std::make_unique<RecordSlot[]>(size))
 		{
-			m_stack.resize(size);
+			if (size == 0 || m_arenaSize > UINT32_MAX)
+				throw std::invalid_argument("[xe::CommandStack] Invalid size");
 		}
 
 		CommandStack()
+			: CommandStack(XE_UNDOREDOSTACK_DEFAULT_SIZE)
+		{
+		}
+
+		// Not copyable: stored commands may not be. Moving keeps every command where it is in the arena.
+		CommandStack(const CommandStack&) = delete;
+		CommandStack& operator=(const CommandStack&) = delete;
+
+		// `other` is left without storage, and can only be assigned to or destroyed
+		CommandStack(CommandStack&& other) noexcept
+		{
+			MoveFrom(other);
+		}
+
+		CommandStack& operator=(CommandStack&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Clear();
+				MoveFrom(other);
+			}
+			return *this;
+		}
+
+		~CommandStack()
+		{
+			Clear();
+		}
+
+		// Constructs T from args directly in the arena, then executes it
+		template <typename T, typename... Args>
+			requires (std::is_constructible_v<T, Args&&...> && !std::is_invocable_v<T&>)
+		void PushAndExecute(Args&&... args)
+		{
+			Emplace<T>(std::forward<Args>(args)...);
+		}
+
+		// Moves (or copies) an existing command object into the arena, then executes it
+		template <typename T>
+			requires (!std::is_invocable_v<std::decay_t<T>&>)
+		void PushAndExecute(T&& command)
 		{
-			m_stack.resize(XE_UNDOREDOSTACK_DEFAULT_SIZE);
+			Emplace<std::decay_t<T>>(std::forward<T>(command));
 		}
 
-		void PushAndExecute(const Command& cmd)
+		template <typename ExecuteFunc, typename RevertFunc>
+			requires (std::is_invocable_v<std::decay_t<ExecuteFunc>&> && std::is_invocable_v<std::decay_t<RevertFunc>&>)
+		void PushAndExecute(ExecuteFunc&& execute, RevertFunc&& revert)
 		{
-			size_t index = 0;
-			if (!IsEmpty() && m_cursorIndex != m_stack.size() - 1)
-				index = m_cursorIndex + 1;
+			using Stored = FunctionCommand<std::decay_t<ExecuteFunc>, std::decay_t<RevertFunc>>;
+			Emplace<Stored>(Stored{ std::forward<ExecuteFunc>(execute), std::forward<RevertFunc>(revert) });
+		}
+
+		// Commands with a MergeWith hook only merge into the top command if it was pushed (or merged into)
+		// less than `seconds` ago. 0 disables merging.
+		void SetMergeWindow(float seconds)
+		{
+			m_mergeWindowNs = static_cast<int64_t>(static_cast<double>(seconds) * 1e9);
+		}
+
+		// Evicts the oldest commands once the sum of their ByteSize() exceeds `bytes`. A transaction is
+		// evicted whole, and the newest command or group is always kept, even if it is larger than the
+		// budget on its own (see IsOverBudget). 0 = no limit.
+		void SetByteBudget(size_t bytes)
+		{
+			m_byteBudget = bytes;
+			EnforceByteBudget();
+		}
+
+		size_t GetByteBudget() const
+		{
+			return m_byteBudget;
+		}
 
-			if (index == m_bottomIndex && !IsEmpty()) // Check increase `bottomIndex`, but not if empty
-				m_bottomIndex = (m_bottomIndex == m_stack.size() - 1) ? 0 : m_bottomIndex + 1;
+		// True when the commands that could not be evicted (the newest group, or undone commands) still
+		// exceed the byte budget
+		bool IsOverBudget() const
+		{
+			return m_byteBudget != 0 && m_bytes > m_byteBudget;
+		}
 
-			m_stack[index] = cmd;
-			m_topIndex = m_cursorIndex = index;
+		// Sum of ByteSize() over every command held, including undone ones
+		size_t ByteSize() const
+		{
+			return m_bytes;
+		}
+
+		// Calls Spill() on every command except the newest `keepInMemory` ones (undone commands count
+		// as newest), then re-measures them. Commands without a Spill hook are left alone.
+		void SpillOlderThan(size_t keepInMemory)
+		{
+			const size_t end = (m_count > keepInMemory) ? m_count - keepInMemory : 0;
+			for (size_t i = 0; i < end; ++i)
+			{
+				RecordHeader& record = Record(i);
+				if (!record.Operations->Spill)
+					continue;
+
+				record.Operations->Spill(Payload(record));
+				RecordSlot& slot = Slot(i);
+				m_bytes -= slot.Bytes;
+				slot.Bytes = record.Operations->ByteSize(Payload(record));
+				m_bytes += slot.Bytes;
+			}
+		}
 
-			cmd.execute();
+		// Commands pushed until the matching EndTransaction form one group: they still execute as they are
+		// pushed, but Undo reverts the whole group (newest first) and Redo re-executes it, in one call.
+		// Transactions nest; only the outermost one forms a group. Undo and Redo do nothing while one is open.
+		// Groups are only ever evicted whole. A push that would need to evict part of the open transaction
+		// (more commands than the stack holds, or more bytes than the arena) throws std::length_error
+		// without executing, and leaves the commands pushed so far as one group.
+		void BeginTransaction()
+		{
+			if (m_transactionDepth++ == 0)
+			{
+				m_transactionSize = 0;
+				m_canMerge = false;
+			}
 		}
 
-		void PushAndExecute(const std::function<void(void)>& execute, const std::function<void(void)>& revert)
+		// `afterBatch` runs once when the group is done, and again after every Undo or Redo of it, so
+		// derived data (ie. a mesh rebuild) is recomputed once per group instead of once per command.
+		// It is not called for an empty group. Stored as one extra record at the top of the group; if that
+		// record does not fit, the transaction still ends (without the callback) and std::length_error is thrown.
+		void EndTransaction(std::function<void(void)> afterBatch = nullptr)
 		{
-			size_t index = 0;
-			if (!IsEmpty() && m_cursorIndex != m_stack.size() - 1)
-				index = m_cursorIndex + 1;
+			if (m_transactionDepth == 0)
+				throw std::logic_error("[xe::CommandStack] EndTransaction without BeginTransaction");
+			if (m_transactionDepth > 1)
+			{
+				--m_transactionDepth;
+				return;
+			}
 
-			if (index == m_bottomIndex && !IsEmpty()) // Check increase `bottomIndex`, but not if empty
-				m_bottomIndex = (m_bottomIndex == m_stack.size() - 1) ? 0 : m_bottomIndex + 1;
+			// Pushed while the transaction is still open, so making room for it cannot evict the group
+			const bool hasCallback = m_transactionSize > 0 && afterBatch;
+			try
+			{
+				if (hasCallback)
+					Emplace<TransactionEnd>(TransactionEnd{ std::move(afterBatch) });
+			}
+			catch (...)
+			{
+				CloseTransaction();
+				throw;
+			}
 
-			m_topIndex = m_cursorIndex = index;
+			CloseTransaction();
+			if (hasCallback)
+				static_cast<TransactionEnd*>(Payload(Record(m_count - 1)))->AfterBatch();
+		}
 
-			Command& cmd = m_stack[index];
-			cmd = Command();
-			cmd.execute = execute;
-			cmd.revert = revert;
+		bool IsInTransaction() const
+		{
+			return m_transactionDepth > 0;
+		}
 
-			cmd.execute();
+		// The next push starts a new command even if it could merge (ie. on mouse release)
+		void BreakMerge()
+		{
+			m_canMerge = false;
 		}
 
+		// Reverts the top command, or the whole transaction group it belongs to
 		void Undo()
 		{
-			if (IsEmpty() || IsPastBottom()) // Empty or at bottom
+			if (IsEmpty() || IsPastBottom() || IsInTransaction()) // Empty or at bottom
 				return;
 
-			m_stack[m_cursorIndex].revert();
+			m_canMerge = false;
+			TransactionEnd* end = nullptr;
+			bool joined;
+			do
+			{
+				--m_cursor;
+				const RecordSlot& slot = Slot(m_cursor);
+				RecordHeader& record = Record(slot);
+				if (!end)
+					end = AsTransactionEnd(record);
+				record.Operations->Revert(Payload(record));
+				joined = slot.Joined;
+			} while (joined && m_cursor > 0);
 
-			if (m_cursorIndex == m_bottomIndex)
-				m_cursorIndex = k_undefined;
-			else if (m_cursorIndex == 0)
-				m_cursorIndex = m_stack.size() - 1;
-			else
-				--m_cursorIndex;
+			if (end)
+				end->AfterBatch();
 		}
 
 		void Redo()
 		{
-			if (IsEmpty() || IsAtTop())
+			if (IsEmpty() || IsAtTop() || IsInTransaction())
 				return;
 
-			size_t index = 0;
-			if (m_cursorIndex == k_undefined)
-				index = m_bottomIndex;
-			else if (m_cursorIndex != m_stack.size() - 1)
-				index = m_cursorIndex + 1;
+			m_canMerge = false;
+			RecordHeader* record = &Record(m_cursor);
+			while (true)
+			{
+				record->Operations->Execute(Payload(*record));
+				if (++m_cursor == m_count)
+					break;
+				const RecordSlot& next = Slot(m_cursor);
+				if (!next.Joined)
+					break;
+				record = &Record(next);
+			}
 
-			m_stack[index].execute();
-			m_cursorIndex = index;
+			if (TransactionEnd* end = AsTransactionEnd(*record))
+				end->AfterBatch();
 		}
 
 		bool IsEmpty() const
 		{
-			return m_topIndex == k_undefined;
+			return m_count == 0;
 		}
 
 		bool IsPastBottom() const
 		{
-			return !IsEmpty() && m_cursorIndex == k_undefined;
+			return !IsEmpty() && m_cursor == 0;
 		}
 
 		bool IsAtTop() const
 		{
-			return m_cursorIndex == m_topIndex;
+			return m_cursor == m_count;
 		}
 
 		void Clear()
 		{
-			m_topIndex = m_cursorIndex = k_undefined;
-			m_bottomIndex = 0;
+			m_canMerge = false;
+			m_transactionSize = 0;
+			DestroyFrom(0);
+			m_bottom = 0;
+			m_cursor = 0;
+			m_arenaHead = 0;
+		}
+
+		// Number of commands held, including ones that were undone (and one per transaction with an after-batch callback)
+		size_t Size() const
+		{
+			return m_count;
 		}
 
 	private:
-		std::vector<Command> m_stack;
+		template <typename T, typename... Args>
+		void Emplace(Args&&... args)
+		{
+			if constexpr (CommandTraits<T>::k_canMerge)
+			{
+				const int64_t now = DefaultClock::Now();
+				if (IsMergeCandidate<T>(now))
+				{
+					// Built on the stack first; it only goes into the arena if it does not merge
+					T next(std::forward<Args>(args)...);
+					CommandTraits<T>::Execute(next);
+					T& top = *static_cast<T*>(Payload(Record(m_count - 1)));
+					if (CommandTraits<T>::Merge(top, next))
+					{
+						RecordSlot& slot = Slot(m_count - 1);
+						m_bytes -= slot.Bytes;
+						slot.Bytes = CommandTraits<T>::ByteSize(top);
+						m_bytes += slot.Bytes;
+						m_lastMergeable = now;
+						EnforceByteBudget();
+						return;
+					}
+
+					void* command;
+					try
+					{
+						command = Allocate<T>();
+					}
+					catch (...)
+					{
+						CommandTraits<T>::Revert(next); // Not on the stack, so it must not stay applied
+						throw;
+					}
+					new (command) T(std::move(next));
+					Commit<T>(command, false);
+				}
+				else
+				{
+					void* command = Allocate<T>();
+					new (command) T(std::forward<Args>(args)...);
+					Commit<T>(command, true);
+				}
+				m_canMerge = true;
+				m_lastMergeable = now;
+			}
+			else
+			{
+				void* command = Allocate<T>();
+				new (command) T(std::forward<Args>(args)...);
+				Commit<T>(command, true);
+			}
+		}
+
+		template <typename T>
+		bool IsMergeCandidate(int64_t now) const
+		{
+			return m_canMerge && !IsEmpty() && IsAtTop()
+				&& Record(m_count - 1).Operations == &k_ops<T>
+				&& m_mergeWindowNs > 0 && now - m_lastMergeable < m_mergeWindowNs;
+		}
+
+		template <typename T>
+		static constexpr size_t RecordSize()
+		{
+			return sizeof(RecordHeader) + (sizeof(T) + k_alignment - 1) / k_alignment * k_alignment;
+		}
+
+		// index < m_maxCommands, so one subtraction wraps it (cheaper than % on the Undo/Redo path)
+		RecordSlot& Slot(size_t index) const
+		{
+			index += m_bottom;
+			if (index >= m_maxCommands)
+				index -= m_maxCommands;
+			return m_records[index];
+		}
+
+		RecordHeader& Record(const RecordSlot& slot) const
+		{
+			return *reinterpret_cast<RecordHeader*>(m_arena.get() + slot.Offset);
+		}
+
+		RecordHeader& Record(size_t index) const
+		{
+			return Record(Slot(index));
+		}
+
+		static void* Payload(RecordHeader& record)
+		{
+			return &record + 1;
+		}
+
+		static TransactionEnd* AsTransactionEnd(RecordHeader& record)
+		{
+			return (record.Operations == &k_ops<TransactionEnd>) ? static_cast<TransactionEnd*>(Payload(record)) : nullptr;
+		}
+
+		void CloseTransaction()
+		{
+			m_transactionDepth = 0;
+			m_transactionSize = 0;
+			m_canMerge = false;
+		}
+
+		// Records in the oldest group: the bottom record and every Joined record above it
+		size_t BottomGroupSize() const
+		{
+			size_t size = 1;
+			while (size < m_count && Slot(size).Joined)
+				++size;
+			return size;
+		}
+
+		// Cuts off redo history, then makes room for a T, evicting the oldest commands if needed
+		template <typename T>
+		void* Allocate()
+		{
+			static_assert(alignof(T) <= k_alignment, "Over-aligned command types are not supported");
+			constexpr size_t size = RecordSize<T>();
+			if (size > m_arenaSize)
+				throw std::length_error("[xe::CommandStack] Command is larger than the arena");
+
+			DestroyFrom(m_cursor);
+			while (true)
+			{
+				if (m_count == 0)
+				{
+					m_bottom = 0;
+					m_arenaHead = 0;
+					return Place(0, size);
+				}
+
+				if (m_count < m_maxCommands)
+				{
+					const size_t tail = m_records[m_bottom].Offset;
+					if (m_arenaHead > tail)
+					{
+						if (m_arenaHead + size <= m_arenaSize)
+							return Place(m_arenaHead, size);
+						if (size <= tail)
+							return Place(0, size); // Wrap; the gap at the end is reclaimed with the tail
+					}
+					else if (m_arenaHead + size <= tail)
+					{
+						return Place(m_arenaHead, size);
+					}
+				}
+
+				// Everything left belongs to the open transaction
+				if (IsInTransaction() && m_transactionSize == m_count)
+					throw std::length_error("[xe::CommandStack] Transaction does not fit in the stack");
+				EvictBottomGroup();
+			}
+		}
+
+		// Reserves the record slot. The command is constructed and committed by the caller.
+		void* Place(size_t offset, size_t size)
+		{
+			m_pendingOffset = static_cast<uint32_t>(offset);
+			RecordHeader* record = new (m_arena.get() + offset) RecordHeader{ nullptr, static_cast<uint32_t>(size) };
+			return Payload(*record);
+		}
+
+		template <typename T>
+		void Commit(void* command, bool execute)
+		{
+			RecordHeader& record = *(static_cast<RecordHeader*>(command) - 1);
+			record.Operations = &k_ops<T>;
+			RecordSlot& slot = Slot(m_count);
+			slot.Offset = m_pendingOffset;
+			slot.Joined = (IsInTransaction() && m_transactionSize++ > 0) || std::is_same_v<T, TransactionEnd>;
+			slot.Bytes = 0;
+			m_arenaHead = m_pendingOffset + record.Size;
+			++m_count;
+			m_cursor = m_count;
+			m_canMerge = false;
+
+			if (execute)
+				record.Operations->Execute(command);
+
+			// Measured after Execute, which is where most commands capture their state
+			slot.Bytes = CommandTraits<T>::ByteSize(*static_cast<T*>(command));
+			m_bytes += slot.Bytes;
+			EnforceByteBudget();
+		}
+
+		// Evicts whole groups, and only applied ones that leave something to undo, so neither a transaction
+		// nor the redo history is split. The top group is always kept, even if it is over budget on its own.
+		void EnforceByteBudget()
+		{
+			while (IsOverBudget() && BottomGroupSize() < m_cursor)
+				EvictBottomGroup();
+		}
+
+		void EvictBottom()
+		{
+			RecordHeader& record = Record(0);
+			record.Operations->Destroy(Payload(record));
+			m_bytes -= Slot(0).Bytes;
+			m_bottom = (m_bottom + 1) % m_maxCommands;
+			--m_count;
+			if (m_cursor > 0)
+				--m_cursor;
+		}
+
+		void EvictBottomGroup()
+		{
+			for (size_t i = BottomGroupSize(); i > 0; --i)
+				EvictBottom();
+		}
+
+		// Destroys commands [first, count), newest first
+		void DestroyFrom(size_t first)
+		{
+			while (m_count > first)
+			{
+				RecordHeader& record = Record(m_count - 1);
+				record.Operations->Destroy(Payload(record));
+				m_bytes -= Slot(m_count - 1).Bytes;
+				--m_count;
+			}
+			if (m_cursor > m_count)
+				m_cursor = m_count;
+			m_arenaHead = (m_count > 0) ? Slot(m_count - 1).Offset + Record(m_count - 1).Size : 0;
+		}
+
+		void MoveFrom(CommandStack& other) noexcept
+		{
+			m_maxCommands = std::exchange(other.m_maxCommands, 0);
+			m_arenaSize = std::exchange(other.m_arenaSize, 0);
+			m_arena = std::move(other.m_arena);
+			m_records = std::move(other.m_records);
+			m_bottom = std::exchange(other.m_bottom, 0);
+			m_count = std::exchange(other.m_count, 0);
+			m_cursor = std::exchange(other.m_cursor, 0);
+			m_arenaHead = std::exchange(other.m_arenaHead, 0);
+			m_pendingOffset = std::exchange(other.m_pendingOffset, 0);
+			m_bytes = std::exchange(other.m_bytes, 0);
+			m_byteBudget = other.m_byteBudget;
+			m_transactionDepth = std::exchange(other.m_transactionDepth, 0);
+			m_transactionSize = std::exchange(other.m_transactionSize, 0);
+			m_canMerge = std::exchange(other.m_canMerge, false);
+			m_lastMergeable = other.m_lastMergeable;
+			m_mergeWindowNs = other.m_mergeWindowNs;
+		}
+
+		size_t m_maxCommands = 0;
+		size_t m_arenaSize = 0;
+		std::unique_ptr<std::byte[]> m_arena; // operator new aligns to at least max_align_t
+		std::unique_ptr<RecordSlot[]> m_records; // A ring starting at m_bottom
+
+		size_t m_bottom = 0; // Ring index of the oldest command
+		size_t m_count = 0;
+		size_t m_cursor = 0; // Commands [0, m_cursor) are applied; behind is undo, ahead is redo
+		size_t m_arenaHead = 0; // Arena offset just past the newest command
+		uint32_t m_pendingOffset = 0;
+		size_t m_bytes = 0;
+		size_t m_byteBudget = XE_COMMANDSTACK_BYTE_BUDGET;
+
+		size_t m_transactionDepth = 0;
+		size_t m_transactionSize = 0; // Records pushed since the outermost BeginTransaction
 
-		size_t m_topIndex = k_undefined; // Index of the most recent command (ie. the end of "redo" action)
-		size_t m_bottomIndex = 0;
-		size_t m_cursorIndex = k_undefined; // Index of the current command (where we currently are in the stack. behind is undo, ahead is redo)
+		bool m_canMerge = false; // The top command was just pushed and can take merges
+		int64_t m_lastMergeable = 0; // When the top command was pushed or last merged into (DefaultClock)
+		int64_t m_mergeWindowNs = static_cast<int64_t>(XE_COMMANDSTACK_MERGE_WINDOW * 1e9);
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,358 @@
+/*========================================================
+
+ XephTools - Concurrent Event
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Invoke works on an immutable snapshot of the callbacks and takes no lock, so any number of
+	threads can invoke the same event at once. Subscribe/Unsubscribe build a new snapshot and
+	swap it in (copy-on-write). Old snapshots are freed once the last Invoke using them returns.
+  - A snapshot is pinned with a reference count. The two epoch counters only guard the few
+	instructions between loading the snapshot pointer and pinning it, so a writer never waits
+	on a running callback.
+  - Subscribe/Unsubscribe called from a callback of the same event are deferred until the
+	outermost Invoke of that event on that thread returns. The returned ID is valid immediately.
+  - Changes made on another thread apply to the next Invoke; an Invoke already running keeps
+	calling the callbacks of its snapshot.
+
+========================================================*/
+
+#ifndef XE_CONCURRENTEVENT_H
+#define XE_CONCURRENTEVENT_H
+
+#include "Event.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace xe
+{
+	// Invokes currently running on this thread, innermost first. Used to detect reentrant writes.
+	struct ConcurrentEventFrame
+	{
+		const void* Event;
+		const ConcurrentEventFrame* Parent;
+
+		static inline thread_local const ConcurrentEventFrame* t_current = nullptr;
+
+		static bool IsDispatching(const void* event)
+		{
+			for (const ConcurrentEventFrame* frame = t_current; frame; frame = frame->Parent)
+			{
+				if (frame->Event == event)
+					return true;
+			}
+			return false;
+		}
+	};
+
+	template <typename Callback>
+	class ConcurrentEventBase
+	{
+	public:
+		ConcurrentEventBase() = default;
+		ConcurrentEventBase(const ConcurrentEventBase&) = delete;
+		ConcurrentEventBase& operator=(const ConcurrentEventBase&) = delete;
+
+		~ConcurrentEventBase()
+		{
+			delete m_snapshot.load(std::memory_order_relaxed);
+		}
+
+		FuncID Subscribe(const Callback& callback)
+		{
+			return Subscribe(Callback(callback));
+		}
+
+		FuncID Subscribe(Callback&& callback)
+		{
+			FuncID id;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				id = NextID();
+				m_added.push_back({ id, std::move(callback) });
+				m_hasPending.store(true, std::memory_order_release);
+			}
+			ApplyUnlessDispatching();
+			return id;
+		}
+
+		[[nodiscard]] Subscription SubscribeScoped(Callback callback)
+		{
+			return Subscription(*this, Subscribe(std::move(callback)));
+		}
+
+		bool Unsubscribe(const FuncID id)
+		{
+			return Unsubscribe(std::span<const FuncID>(&id, 1)) != 0;
+		}
+
+		// Publishes one new snapshot for the whole batch. Returns how many of the IDs were subscribed.
+		size_t Unsubscribe(std::span<const FuncID> ids)
+		{
+			size_t count = 0;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (FuncID id : ids)
+				{
+					auto added = std::find_if(m_added.begin(), m_added.end(), [id](const Entry& entry) { return entry.ID == id; });
+					if (added != m_added.end())
+					{
+						m_added.erase(added);
+					}
+					else
+					{
+						if (!m_current || !m_current->Find(id)
+							|| std::find(m_removed.begin(), m_removed.end(), id) != m_removed.end())
+						{
+							continue;
+						}
+						m_removed.push_back(id);
+					}
+					++count;
+				}
+				if (count == 0)
+					return 0;
+				m_hasPending.store(true, std::memory_order_release);
+			}
+			ApplyUnlessDispatching();
+			return count;
+		}
+
+		// Includes changes that are still deferred
+		bool Contains(const FuncID id) const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (std::find_if(m_added.begin(), m_added.end(), [id](const Entry& entry) { return entry.ID == id; }) != m_added.end())
+				return true;
+			return m_current && m_current->Find(id)
+				&& std::find(m_removed.begin(), m_removed.end(), id) == m_removed.end();
+		}
+
+		void Clear()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_added.clear();
+				m_removed.clear();
+				if (m_current)
+				{
+					for (const Entry& entry : m_current->Entries)
+						m_removed.push_back(entry.ID);
+				}
+				m_hasPending.store(true, std::memory_order_release);
+			}
+			ApplyUnlessDispatching();
+		}
+
+		// Number of callbacks the next Invoke will call, not counting deferred changes
+		size_t Size() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return (m_current) ? m_current->Entries.size() : 0;
+		}
+
+	protected:
+		template <typename... Args>
+		void Dispatch(const Args&... args) const
+		{
+			Snapshot* snapshot = Pin();
+			ConcurrentEventFrame frame{ this, ConcurrentEventFrame::t_current };
+			ConcurrentEventFrame::t_current = &frame;
+
+			// Unpins and applies deferred changes even if a callback throws
+			struct Guard
+			{
+				const ConcurrentEventBase* Owner;
+				Snapshot* Pinned;
+				const ConcurrentEventFrame* Frame;
+
+				~Guard()
+				{
+					ConcurrentEventFrame::t_current = Frame->Parent;
+					if (Pinned)
+						Owner->Unpin(Pinned);
+					if (Owner->m_hasPending.load(std::memory_order_acquire) && !ConcurrentEventFrame::IsDispatching(Owner))
+						const_cast<ConcurrentEventBase*>(Owner)->Apply();
+				}
+			} guard{ this, snapshot, &frame };
+
+			if (!snapshot)
+				return;
+
+			for (const Entry& entry : snapshot->Entries)
+				entry.Func(args...);
+		}
+
+	private:
+		struct Entry
+		{
+			FuncID ID;
+			Callback Func;
+		};
+
+		// Immutable once published. Refs counts the Invokes using it, plus one while it is current.
+		struct Snapshot
+		{
+			std::atomic<uint32_t> Refs = 1;
+			std::vector<Entry> Entries;
+
+			bool Find(FuncID id) const
+			{
+				return std::find_if(Entries.begin(), Entries.end(), [id](const Entry& entry) { return entry.ID == id; }) != Entries.end();
+			}
+		};
+
+		FuncID NextID()
+		{
+			if (++m_lastID == k_invalidFuncID)
+				++m_lastID;
+			return m_lastID;
+		}
+
+		Snapshot* Pin() const
+		{
+			const uint32_t epoch = m_epoch.load(std::memory_order_relaxed) & 1;
+			m_readers[epoch].Count.fetch_add(1, std::memory_order_seq_cst);
+			Snapshot* snapshot = m_snapshot.load(std::memory_order_seq_cst);
+			if (snapshot)
+				snapshot->Refs.fetch_add(1, std::memory_order_relaxed);
+			m_readers[epoch].Count.fetch_sub(1, std::memory_order_release);
+			return snapshot;
+		}
+
+		void Unpin(Snapshot* snapshot) const
+		{
+			if (snapshot->Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete snapshot;
+		}
+
+		void ApplyUnlessDispatching()
+		{
+			if (!ConcurrentEventFrame::IsDispatching(this))
+				Apply();
+		}
+
+		// Builds and publishes a snapshot with every pending change
+		void Apply()
+		{
+			Snapshot* previous;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_hasPending.load(std::memory_order_relaxed))
+					return;
+
+				Snapshot* next = nullptr;
+				const size_t kept = (m_current) ? m_current->Entries.size() - m_removed.size() : 0;
+				if (kept + m_added.size() > 0)
+				{
+					next = new Snapshot();
+					next->Entries.reserve(kept + m_added.size());
+					if (m_current)
+					{
+						std::sort(m_removed.begin(), m_removed.end());
+						for (const Entry& entry : m_current->Entries)
+						{
+							if (!std::binary_search(m_removed.begin(), m_removed.end(), entry.ID))
+								next->Entries.push_back(entry);
+						}
+					}
+					for (Entry& entry : m_added)
+						next->Entries.push_back(std::move(entry));
+				}
+
+				m_added.clear();
+				m_removed.clear();
+				m_hasPending.store(false, std::memory_order_relaxed);
+
+				previous = m_current;
+				m_current = next;
+				m_snapshot.store(next, std::memory_order_seq_cst);
+			}
+
+			if (!previous)
+				return;
+
+			WaitForPinning();
+			Unpin(previous);
+		}
+
+		// Waits until no Invoke is between loading the old snapshot pointer and pinning it.
+		// Flipping the epoch first sends new readers to the other counter, so this always finishes.
+		void WaitForPinning()
+		{
+			std::lock_guard<std::mutex> lock(m_epochMutex);
+			for (int i = 0; i < 2; ++i)
+			{
+				const uint32_t epoch = m_epoch.load(std::memory_order_relaxed);
+				m_epoch.store(epoch + 1, std::memory_order_seq_cst);
+				while (m_readers[epoch & 1].Count.load(std::memory_order_seq_cst) != 0)
+					std::this_thread::yield();
+			}
+		}
+
+		struct ReaderCount
+		{
+			alignas(64) std::atomic<uint32_t> Count = 0;
+		};
+
+		std::atomic<Snapshot*> m_snapshot = nullptr;
+		mutable ReaderCount m_readers[2];
+		std::atomic<uint32_t> m_epoch = 0;
+		std::mutex m_epochMutex;
+		std::atomic<bool> m_hasPending = false;
+
+		// Everything below is guarded by m_mutex
+		mutable std::mutex m_mutex;
+		Snapshot* m_current = nullptr;
+		std::vector<Entry> m_added;
+		std::vector<FuncID> m_removed;
+		FuncID m_lastID = k_invalidFuncID;
+	};
+
+	template <typename Context = void, typename Callback = std::function<typename EventSignature<Context>::Type>>
+	class ConcurrentEvent : public ConcurrentEventBase<Callback>
+	{
+	public:
+		void Invoke(const Context& ctx) const
+		{
+			this->Dispatch(ctx);
+		}
+	};
+
+	template <typename Callback>
+	class ConcurrentEvent<void, Callback> : public ConcurrentEventBase<Callback>
+	{
+	public:
+		void Invoke() const
+		{
+			this->Dispatch();
+		}
+	};
+}
+
+#endif // !XE_CONCURRENTEVENT_H
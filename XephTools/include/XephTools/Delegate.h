@@ -0,0 +1,280 @@
+/*========================================================
+
+ XephTools - Delegate
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Callables are stored in an inline buffer of BufferSize bytes. One that does not fit is a
+	compile error, unless AllowHeap is true, in which case it is heap allocated.
+  - Trivially copyable callables (function pointers, lambdas capturing pointers or values, bound
+	members) are copied with memcpy and need no destructor call.
+  - XE_DELEGATE(Class::Func) binds a member function to `this` with the function known at
+	compile time: calling it is one indirect call, with no std::bind.
+
+========================================================*/
+
+#ifndef XE_DELEGATE_H
+#define XE_DELEGATE_H
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifndef XE_DELEGATE_BUFFER_SIZE
+#define XE_DELEGATE_BUFFER_SIZE (4 * sizeof(void*))
+#endif // XE_DELEGATE_BUFFER_SIZE
+
+namespace xe
+{
+	template <typename Signature, size_t BufferSize = XE_DELEGATE_BUFFER_SIZE, bool AllowHeap = false>
+	class Delegate;
+
+	template <typename R, typename... Args, size_t BufferSize, bool AllowHeap>
+	class Delegate<R(Args...), BufferSize, AllowHeap>
+	{
+	private:
+		static_assert(BufferSize >= sizeof(void*), "Delegate buffer must hold at least a pointer");
+
+		template <typename F>
+		static constexpr bool k_fitsInline = sizeof(F) <= BufferSize && alignof(F) <= alignof(std::max_align_t)
+			&& std::is_nothrow_move_constructible_v<F>;
+
+	public:
+		Delegate() = default;
+		Delegate(std::nullptr_t) {}
+
+		// Any callable: lambda, functor or function pointer
+		template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Delegate> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+		Delegate(F&& callable)
+		{
+			using Stored = std::decay_t<F>;
+			if constexpr (std::is_pointer_v<Stored> || std::is_member_pointer_v<Stored>)
+			{
+				if (IsNull(callable))
+					return;
+			}
+
+			if constexpr (k_fitsInline<Stored>)
+			{
+				new (m_buffer) Stored(std::forward<F>(callable));
+				m_invoke = &InvokeInline<Stored>;
+				m_ops = std::is_trivially_copyable_v<Stored> ? nullptr : &k_inlineOps<Stored>;
+			}
+			else
+			{
+				static_assert(AllowHeap && sizeof(F) > 0, "Callable does not fit in the Delegate buffer. Increase BufferSize or set AllowHeap.");
+				*reinterpret_cast<Stored**>(m_buffer) = new Stored(std::forward<F>(callable));
+				m_invoke = &InvokeHeap<Stored>;
+				m_ops = &k_heapOps<Stored>;
+			}
+		}
+
+		// Member function known at compile time, called directly on `object`
+		template <auto Method, typename T>
+		static Delegate Bind(T* object)
+		{
+			Delegate result;
+			*reinterpret_cast<T**>(result.m_buffer) = object;
+			result.m_invoke = &InvokeMember<Method, T>;
+			return result;
+		}
+
+		Delegate(const Delegate& other)
+		{
+			CopyFrom(other);
+		}
+
+		Delegate(Delegate&& other) noexcept
+		{
+			MoveFrom(other);
+		}
+
+		Delegate& operator=(const Delegate& other)
+		{
+			if (this != &other)
+			{
+				Reset();
+				CopyFrom(other);
+			}
+			return *this;
+		}
+
+		Delegate& operator=(Delegate&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				MoveFrom(other);
+			}
+			return *this;
+		}
+
+		Delegate& operator=(std::nullptr_t)
+		{
+			Reset();
+			return *this;
+		}
+
+		~Delegate()
+		{
+			Reset();
+		}
+
+		R operator()(Args... args) const
+		{
+			if (!m_invoke)
+				throw std::bad_function_call();
+			return m_invoke(const_cast<unsigned char*>(m_buffer), std::forward<Args>(args)...);
+		}
+
+		explicit operator bool() const
+		{
+			return m_invoke != nullptr;
+		}
+
+		void Reset()
+		{
+			if (m_ops)
+				m_ops->Destroy(m_buffer);
+			m_invoke = nullptr;
+			m_ops = nullptr;
+		}
+
+	private:
+		using Invoker = R(*)(void*, Args&&...);
+
+		// nullptr Ops means the stored bytes are trivially copyable
+		struct Ops
+		{
+			void (*Copy)(void* dst, const void* src);
+			void (*Move)(void* dst, void* src) noexcept;
+			void (*Destroy)(void* storage) noexcept;
+		};
+
+		template <typename F>
+		static bool IsNull(F callable)
+		{
+			return callable == nullptr;
+		}
+
+		template <typename F>
+		static R InvokeInline(void* storage, Args&&... args)
+		{
+			return std::invoke(*static_cast<F*>(storage), std::forward<Args>(args)...);
+		}
+
+		template <typename F>
+		static R InvokeHeap(void* storage, Args&&... args)
+		{
+			return std::invoke(**static_cast<F**>(storage), std::forward<Args>(args)...);
+		}
+
+		template <auto Method, typename T>
+		static R InvokeMember(void* storage, Args&&... args)
+		{
+			return std::invoke(Method, *static_cast<T**>(storage), std::forward<Args>(args)...);
+		}
+
+		template <typename F>
+		static constexpr Ops k_inlineOps =
+		{
+			[](void* dst, const void* src) { new (dst) F(*static_cast<const F*>(src)); },
+			[](void* dst, void* src) noexcept { new (dst) F(std::move(*static_cast<F*>(src))); static_cast<F*>(src)->~F(); },
+			[](void* storage) noexcept { static_cast<F*>(storage)->~F(); },
+		};
+
+		template <typename F>
+		static constexpr Ops k_heapOps =
+		{
+			[](void* dst, const void* src) { *static_cast<F**>(dst) = new F(**static_cast<F* const*>(src)); },
+			[](void* dst, void* src) noexcept { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+			[](void* storage) noexcept { delete *static_cast<F**>(storage); },
+		};
+
+		void CopyFrom(const Delegate& other)
+		{
+			if (other.m_ops)
+				other.m_ops->Copy(m_buffer, other.m_buffer);
+			else
+				std::memcpy(m_buffer, other.m_buffer, BufferSize);
+			m_invoke = other.m_invoke;
+			m_ops = other.m_ops;
+		}
+
+		// Leaves `other` empty
+		void MoveFrom(Delegate& other) noexcept
+		{
+			if (other.m_ops)
+				other.m_ops->Move(m_buffer, other.m_buffer);
+			else
+				std::memcpy(m_buffer, other.m_buffer, BufferSize);
+			m_invoke = other.m_invoke;
+			m_ops = other.m_ops;
+			other.m_invoke = nullptr;
+			other.m_ops = nullptr;
+		}
+
+		alignas(std::max_align_t) unsigned char m_buffer[BufferSize];
+		Invoker m_invoke = nullptr;
+		const Ops* m_ops = nullptr;
+	};
+
+	// Deduces the Delegate signature from a member function pointer
+	template <typename Method>
+	struct DelegateMethodTraits;
+
+	template <typename R, typename T, typename... Args>
+	struct DelegateMethodTraits<R(T::*)(Args...)>
+	{
+		using Type = Delegate<R(Args...)>;
+	};
+
+	template <typename R, typename T, typename... Args>
+	struct DelegateMethodTraits<R(T::*)(Args...) const>
+	{
+		using Type = Delegate<R(Args...)>;
+	};
+
+	template <typename R, typename T, typename... Args>
+	struct DelegateMethodTraits<R(T::*)(Args...) noexcept>
+	{
+		using Type = Delegate<R(Args...)>;
+	};
+
+	template <typename R, typename T, typename... Args>
+	struct DelegateMethodTraits<R(T::*)(Args...) const noexcept>
+	{
+		using Type = Delegate<R(Args...)>;
+	};
+
+	template <auto Method, typename T>
+	typename DelegateMethodTraits<decltype(Method)>::Type BindDelegate(T* object)
+	{
+		return DelegateMethodTraits<decltype(Method)>::Type::template Bind<Method>(object);
+	}
+}
+
+#define XE_DELEGATE(function) xe::BindDelegate<&function>(this) // function must be in format "ClassName::FuncName"
+#define XE_DELEGATE_PTR(function, ptr) xe::BindDelegate<&function>(ptr) // function must be in format "ClassName::FuncName"
+
+#endif // !XE_DELEGATE_H
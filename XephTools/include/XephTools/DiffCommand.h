@@ -0,0 +1,293 @@
+/*========================================================
+
+ XephTools - Diff Command
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Undo/redo for an edit to a large memory region (tilemap, sample buffer, image) that stores
+	only the XOR of the before and after bytes, run-length encoded:
+	  repeated: varint unchangedBytes | varint changedBytes | changedBytes XOR bytes
+	XOR is its own inverse, so the same pass applies the edit forward and backward in place.
+  - The region must stay at the same address and size for as long as the command is on the stack.
+  - Spill() writes the encoded diff to a new, uniquely named file in the spill directory and frees
+	it from memory.
+	CommandStack::SpillOlderThan calls it on old entries. The file is removed with the command.
+
+========================================================*/
+
+#ifndef XE_DIFFCOMMAND_H
+#define XE_DIFFCOMMAND_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace xe
+{
+	class DiffCommand
+	{
+	public:
+		// Call after editing `region`: `before` is a copy of the region from before the edit.
+		// The edit is already applied, so the first Execute (from PushAndExecute) does nothing.
+		DiffCommand(void* region, size_t size, const void* before)
+			: m_region(static_cast<uint8_t*>(region)), m_size(size)
+		{
+			Encode(static_cast<const uint8_t*>(before), m_region, size, m_encoded);
+			m_encoded.shrink_to_fit();
+		}
+
+		DiffCommand(const DiffCommand&) = delete;
+		DiffCommand& operator=(const DiffCommand&) = delete;
+
+		DiffCommand(DiffCommand&& other) noexcept
+			: m_region(other.m_region), m_size(other.m_size), m_encoded(std::move(other.m_encoded))
+			, m_encodedSize(other.m_encodedSize), m_spillPath(std::move(other.m_spillPath)), m_applied(other.m_applied)
+		{
+			other.m_spillPath.clear();
+		}
+
+		DiffCommand& operator=(DiffCommand&& other) = delete;
+
+		~DiffCommand()
+		{
+			if (!m_spillPath.empty())
+			{
+				std::error_code error;
+				std::filesystem::remove(m_spillPath, error);
+			}
+		}
+
+		void Execute()
+		{
+			if (!m_applied)
+				Apply();
+			m_applied = true;
+		}
+
+		void Revert()
+		{
+			if (m_applied)
+				Apply();
+			m_applied = false;
+		}
+
+		size_t ByteSize() const
+		{
+			return sizeof(DiffCommand) + m_encoded.capacity();
+		}
+
+		// Size of the diff, in memory or on disk
+		size_t EncodedSize() const
+		{
+			return IsSpilled() ? m_encodedSize : m_encoded.size();
+		}
+
+		bool IsSpilled() const
+		{
+			return !m_spillPath.empty();
+		}
+
+		void Spill()
+		{
+			if (IsSpilled() || m_encoded.empty())
+				return;
+
+			std::filesystem::path path;
+			std::FILE* file = CreateSpillFile(path);
+			const bool written = std::fwrite(m_encoded.data(), 1, m_encoded.size(), file) == m_encoded.size();
+			if (std::fclose(file) != 0 || !written)
+			{
+				std::error_code error;
+				std::filesystem::remove(path, error);
+				throw std::runtime_error("[xe::DiffCommand] Could not write " + path.string());
+			}
+
+			m_encodedSize = m_encoded.size();
+			m_spillPath = std::move(path);
+			std::vector<uint8_t>().swap(m_encoded);
+		}
+
+		// Defaults to the system temp directory
+		static void SetSpillDirectory(const std::filesystem::path& directory)
+		{
+			SpillDirectory() = directory;
+		}
+
+		static std::filesystem::path& SpillDirectory()
+		{
+			static std::filesystem::path directory = std::filesystem::temp_directory_path();
+			return directory;
+		}
+
+	private:
+		// Names carry a random per-process token and the file is created exclusively ("x"), so processes
+		// sharing the spill directory never overwrite (or later delete) each other's files
+		static std::FILE* CreateSpillFile(std::filesystem::path& path)
+		{
+			static const uint64_t token = (static_cast<uint64_t>(std::random_device()()) << 32) | std::random_device()();
+
+			char name[64];
+			for (int attempt = 0; attempt < 16; ++attempt)
+			{
+				std::snprintf(name, sizeof(name), "xe_diff_%016llx_%llu.bin",
+					static_cast<unsigned long long>(token), static_cast<unsigned long long>(s_nextSpill.fetch_add(1)));
+				path = SpillDirectory() / name;
+#ifdef _WIN32
+				std::FILE* file = _wfopen(path.c_str(), L"wbx");
+#else
+				std::FILE* file = std::fopen(path.c_str(), "wbx");
+#endif // _WIN32
+				if (file)
+					return file;
+				if (!std::filesystem::is_directory(SpillDirectory()))
+					break;
+			}
+			throw std::runtime_error("[xe::DiffCommand] Could not create a spill file in " + SpillDirectory().string());
+		}
+
+		// Changed bytes closer together than this stay in one run, since a new run header costs about as much
+		static constexpr size_t k_minGap = 4;
+
+		static void WriteVarint(std::vector<uint8_t>& out, size_t value)
+		{
+			while (value >= 0x80)
+			{
+				out.push_back(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		static size_t ReadVarint(const uint8_t*& in, const uint8_t* end)
+		{
+			size_t value = 0;
+			for (int shift = 0; in < end; shift += 7)
+			{
+				const uint8_t byte = *in++;
+				value |= static_cast<size_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+			throw std::runtime_error("[xe::DiffCommand] Corrupt diff");
+		}
+
+		// Skips unchanged bytes 8 at a time
+		static size_t CountEqual(const uint8_t* a, const uint8_t* b, size_t count)
+		{
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				uint64_t wordA, wordB;
+				std::memcpy(&wordA, a + i, 8);
+				std::memcpy(&wordB, b + i, 8);
+				if (wordA != wordB)
+					break;
+			}
+			while (i < count && a[i] == b[i])
+				++i;
+			return i;
+		}
+
+		static void Encode(const uint8_t* before, const uint8_t* after, size_t size, std::vector<uint8_t>& out)
+		{
+			size_t position = 0;
+			while (position < size)
+			{
+				const size_t equal = CountEqual(before + position, after + position, size - position);
+				if (position + equal == size)
+					break;
+
+				// The run ends at the first gap of k_minGap unchanged bytes
+				const size_t start = position + equal;
+				size_t end = start + 1;
+				while (end < size)
+				{
+					if (before[end] != after[end])
+					{
+						++end;
+						continue;
+					}
+					const size_t gap = CountEqual(before + end, after + end, std::min(k_minGap, size - end));
+					if (gap >= k_minGap || end + gap == size)
+						break;
+					end += gap;
+				}
+
+				WriteVarint(out, equal);
+				WriteVarint(out, end - start);
+				for (size_t i = start; i < end; ++i)
+					out.push_back(before[i] ^ after[i]);
+				position = end;
+			}
+		}
+
+		void Apply()
+		{
+			std::vector<uint8_t> spilled;
+			const std::vector<uint8_t>* encoded = &m_encoded;
+			if (IsSpilled())
+			{
+				spilled.resize(m_encodedSize);
+				std::ifstream file(m_spillPath, std::ios::binary);
+				file.read(reinterpret_cast<char*>(spilled.data()), static_cast<std::streamsize>(spilled.size()));
+				if (!file)
+					throw std::runtime_error("[xe::DiffCommand] Could not read " + m_spillPath.string());
+				encoded = &spilled;
+			}
+
+			const uint8_t* in = encoded->data();
+			const uint8_t* end = in + encoded->size();
+			size_t position = 0;
+			while (in < end)
+			{
+				position += ReadVarint(in, end);
+				const size_t count = ReadVarint(in, end);
+				if (position + count > m_size || count > static_cast<size_t>(end - in))
+					throw std::runtime_error("[xe::DiffCommand] Corrupt diff");
+
+				for (size_t i = 0; i < count; ++i)
+					m_region[position + i] ^= in[i];
+				in += count;
+				position += count;
+			}
+		}
+
+		static inline std::atomic<uint64_t> s_nextSpill = 0;
+
+		uint8_t* m_region;
+		size_t m_size;
+		std::vector<uint8_t> m_encoded;
+		size_t m_encodedSize = 0;
+		std::filesystem::path m_spillPath;
+		bool m_applied = true;
+	};
+}
+
+#endif // !XE_DIFFCOMMAND_H
@@ -20,116 +20,344 @@
 
  3. This notice may not be removed or altered from any source distribution.
 
+ Note:
+  - Callbacks are stored in a dense array (slot map). Invoke iterates it linearly and
+	Unsubscribe swap-removes, so invocation order is not subscription order.
+  - A FuncID packs a slot index with the slot's generation. Unsubscribing bumps the generation,
+	so stale IDs are rejected instead of removing whichever callback reused the slot.
+	Generations wrap after 65535 reuses of a slot (skipping 0, which is never a valid ID), so only
+	an ID held across that many unsubscribes of the same slot can match again.
+  - Callbacks are std::function by default. xe::DelegateEvent<Context> stores xe::Delegate instead,
+	which never allocates and binds member functions without std::bind (see Delegate.h).
+  - xe::Subscription unsubscribes on destruction and xe::SubscriptionGroup unsubscribes many at
+	once, grouped per event.
+  - InvokeParallel only spreads callbacks subscribed with SubscribeParallel across the thread pool
+	(see ThreadPool.h). The flag lives in the slot table, so Invoke does not pay for it.
+  - xe::PriorityEvent keeps callbacks sorted by priority and stops at the first one that returns true.
+	Unsubscribe keeps the order, so it is O(n) there.
+
 ========================================================*/
 
 #ifndef XE_EVENT_H
 #define XE_EVENT_H
 
+#include "Delegate.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
 #include <cstdint>
 #include <functional>
-#include <random>
+#include <span>
+#include <stdexcept>
 #include <type_traits>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace xe
 {
 	using FuncID = uint32_t;
 
-	template <typename Context = void, typename Enable = void>
-	class Event;
+	// Never returned by Subscribe. Safe to pass to Unsubscribe.
+	inline constexpr FuncID k_invalidFuncID = 0;
 
-	template <typename Context>
-	class Event<typename Context, typename std::enable_if_t<std::is_void_v<Context>>>
+	// Unsubscribes when destroyed. Works with any event that has Unsubscribe(std::span<const FuncID>).
+	// Must not outlive the event it was subscribed to.
+	class Subscription
 	{
 	public:
+		Subscription() = default;
+
+		template <typename EventType>
+		Subscription(EventType& event, FuncID id)
+			: m_event(&event), m_id(id), m_unsubscribe(&UnsubscribeFrom<EventType>)
+		{
+		}
+
+		Subscription(const Subscription&) = delete;
+		Subscription& operator=(const Subscription&) = delete;
+
+		Subscription(Subscription&& other) noexcept
+			: m_event(other.m_event), m_id(other.m_id), m_unsubscribe(other.m_unsubscribe)
+		{
+			other.Release();
+		}
+
+		Subscription& operator=(Subscription&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				m_event = other.m_event;
+				m_id = other.m_id;
+				m_unsubscribe = other.m_unsubscribe;
+				other.Release();
+			}
+			return *this;
+		}
+
+		~Subscription()
+		{
+			Reset();
+		}
 
-		FuncID Subscribe(const std::function<void(Context)>& callback)
+		// Unsubscribes now
+		void Reset()
 		{
-			FuncID id = NewID();
-			m_callbacks[id] = callback;
+			if (m_event)
+				m_unsubscribe(m_event, std::span<const FuncID>(&m_id, 1));
+			Release();
+		}
+
+		// Keeps the callback subscribed and returns its ID
+		FuncID Release()
+		{
+			const FuncID id = m_id;
+			m_event = nullptr;
+			m_id = k_invalidFuncID;
+			m_unsubscribe = nullptr;
 			return id;
 		}
 
-		bool Unsubscribe(const FuncID id)
+		FuncID GetID() const
 		{
-			if (!Contains(id))
-				return false;
-			m_callbacks.erase(id);
-			return true;
+			return m_id;
 		}
 
-		void Invoke() const
+		explicit operator bool() const
+		{
+			return m_event != nullptr;
+		}
+
+	private:
+		friend class SubscriptionGroup;
+
+		using Unsubscriber = void(*)(void* event, std::span<const FuncID> ids);
+
+		template <typename EventType>
+		static void UnsubscribeFrom(void* event, std::span<const FuncID> ids)
+		{
+			static_cast<EventType*>(event)->Unsubscribe(ids);
+		}
+
+		void* m_event = nullptr;
+		FuncID m_id = k_invalidFuncID;
+		Unsubscriber m_unsubscribe = nullptr;
+	};
+
+	// Owns many subscriptions, possibly to different events. Clear (or the destructor) sorts them
+	// by event and hands each event all of its IDs in one Unsubscribe call.
+	class SubscriptionGroup
+	{
+	public:
+		SubscriptionGroup() = default;
+		SubscriptionGroup(const SubscriptionGroup&) = delete;
+		SubscriptionGroup& operator=(const SubscriptionGroup&) = delete;
+		SubscriptionGroup(SubscriptionGroup&&) noexcept = default;
+
+		SubscriptionGroup& operator=(SubscriptionGroup&& other) noexcept
 		{
-			for (const auto& cb : m_callbacks)
+			if (this != &other)
 			{
-				cb.second();
+				Clear();
+				m_entries = std::move(other.m_entries);
 			}
+			return *this;
 		}
 
-		bool Contains(const FuncID id) const
+		~SubscriptionGroup()
 		{
-			return m_callbacks.find(id) != m_callbacks.end();
+			Clear();
+		}
+
+		template <typename EventType, typename Func>
+		FuncID Subscribe(EventType& event, Func&& callback)
+		{
+			const FuncID id = event.Subscribe(std::forward<Func>(callback));
+			Add(Subscription(event, id));
+			return id;
 		}
-		
+
+		void Add(Subscription&& subscription)
+		{
+			if (!subscription)
+				return;
+			m_entries.push_back({ subscription.m_event, subscription.m_unsubscribe, subscription.m_id });
+			subscription.Release();
+		}
+
 		void Clear()
 		{
-			m_callbacks.clear();
+			if (m_entries.empty())
+				return;
+
+			std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return std::less<void*>()(a.Event, b.Event); });
+
+			std::vector<FuncID> ids;
+			ids.reserve(m_entries.size());
+			size_t first = 0;
+			while (first < m_entries.size())
+			{
+				size_t last = first;
+				ids.clear();
+				while (last < m_entries.size() && m_entries[last].Event == m_entries[first].Event)
+					ids.push_back(m_entries[last++].ID);
+
+				m_entries[first].Unsubscribe(m_entries[first].Event, ids);
+				first = last;
+			}
+			m_entries.clear();
 		}
 
 		size_t Size() const
 		{
-			return m_callbacks.size();
+			return m_entries.size();
 		}
 
-	private:
-		FuncID NewID() const
+		void Reserve(size_t count)
 		{
-			std::random_device rd;
-			std::mt19937 gen(rd());
-			std::uniform_int_distribution<uint32_t> dis(0, UINT32_MAX);
-			return dis(gen);
+			m_entries.reserve(count);
 		}
 
-		std::unordered_map<FuncID, std::function<void(Context)>> m_callbacks;
+	private:
+		struct Entry
+		{
+			void* Event;
+			Subscription::Unsubscriber Unsubscribe;
+			FuncID ID;
+		};
 
+		std::vector<Entry> m_entries;
 	};
 
-	template <typename Context>
-	class Event<typename Context, typename std::enable_if_t<!std::is_void_v<Context>>>
+	// Slot map shared by every Event specialization. Callback is the stored callable type.
+	// Ordered keeps m_callbacks in insertion order on Unsubscribe (O(n)) instead of swap-removing.
+	template <typename Callback, bool Ordered = false>
+	class EventBase
 	{
 	public:
+		FuncID Subscribe(const Callback& callback)
+		{
+			const uint32_t slot = AcquireSlot();
+			m_callbacks.push_back(callback);
+			return MakeID(slot, m_slots[slot].Generation);
+		}
 
-		FuncID Subscribe(const std::function<void(Context)>& callback)
+		FuncID Subscribe(Callback&& callback)
 		{
-			FuncID id = NewID();
-			m_callbacks[id] = callback;
-			return id;
+			const uint32_t slot = AcquireSlot();
+			m_callbacks.push_back(std::move(callback));
+			return MakeID(slot, m_slots[slot].Generation);
+		}
+
+		// For callbacks that are safe to run on a worker thread, at the same time as the others.
+		// InvokeParallel runs these on the thread pool; Invoke treats them like any other callback.
+		FuncID SubscribeParallel(Callback callback) requires (!Ordered)
+		{
+			const uint32_t slot = AcquireSlot();
+			m_slots[slot].ParallelSafe = true;
+			m_callbacks.push_back(std::move(callback));
+			return MakeID(slot, m_slots[slot].Generation);
+		}
+
+		// Subscribes and returns a handle that unsubscribes when destroyed
+		[[nodiscard]] Subscription SubscribeScoped(Callback callback) requires (!Ordered)
+		{
+			return Subscription(*this, Subscribe(std::move(callback)));
+		}
+
+		// Returns how many of the IDs were subscribed. Ordered events compact the array in one pass.
+		size_t Unsubscribe(std::span<const FuncID> ids)
+		{
+			if constexpr (!Ordered)
+			{
+				size_t count = 0;
+				for (FuncID id : ids)
+					count += Unsubscribe(id) ? 1 : 0;
+				return count;
+			}
+			else
+			{
+				uint32_t first = UINT32_MAX;
+				size_t count = 0;
+				for (FuncID id : ids)
+				{
+					if (!Contains(id))
+						continue;
+
+					const uint32_t slot = SlotIndex(id);
+					const uint32_t index = m_slots[slot].DenseIndex;
+					m_denseSlots[index] = k_noSlot;
+					first = std::min(first, index);
+					ReleaseSlot(slot);
+					++count;
+				}
+				if (count == 0)
+					return 0;
+
+				uint32_t write = first;
+				for (uint32_t read = first; read < m_denseSlots.size(); ++read)
+				{
+					if (m_denseSlots[read] == k_noSlot)
+						continue;
+					if (write != read)
+					{
+						m_callbacks[write] = std::move(m_callbacks[read]);
+						m_denseSlots[write] = m_denseSlots[read];
+					}
+					++write;
+				}
+				m_callbacks.erase(m_callbacks.begin() + write, m_callbacks.end());
+				m_denseSlots.resize(write);
+				UpdateDenseIndices(first);
+				return count;
+			}
 		}
 
 		bool Unsubscribe(const FuncID id)
 		{
 			if (!Contains(id))
 				return false;
-			m_callbacks.erase(id);
-			return true;
-		}
 
-		void Invoke(const Context& ctx) const
-		{
-			for (const auto& cb : m_callbacks)
+			const uint32_t slot = SlotIndex(id);
+			const uint32_t index = m_slots[slot].DenseIndex;
+			if constexpr (Ordered)
+			{
+				m_callbacks.erase(m_callbacks.begin() + index);
+				m_denseSlots.erase(m_denseSlots.begin() + index);
+				UpdateDenseIndices(index);
+			}
+			else
 			{
-				cb.second(ctx);
+				const uint32_t last = static_cast<uint32_t>(m_callbacks.size() - 1);
+				if (index != last)
+				{
+					m_callbacks[index] = std::move(m_callbacks[last]);
+					m_denseSlots[index] = m_denseSlots[last];
+					m_slots[m_denseSlots[index]].DenseIndex = index;
+				}
+				m_callbacks.pop_back();
+				m_denseSlots.pop_back();
 			}
+
+			ReleaseSlot(slot);
+			return true;
 		}
 
 		bool Contains(const FuncID id) const
 		{
-			return m_callbacks.find(id) != m_callbacks.end();
+			const uint32_t slot = SlotIndex(id);
+			return slot < m_slots.size()
+				&& m_slots[slot].Generation == Generation(id)
+				&& m_slots[slot].DenseIndex < m_denseSlots.size()
+				&& m_denseSlots[m_slots[slot].DenseIndex] == slot;
 		}
 
 		void Clear()
 		{
+			for (uint32_t slot : m_denseSlots)
+				ReleaseSlot(slot);
 			m_callbacks.clear();
+			m_denseSlots.clear();
 		}
 
 		size_t Size() const
@@ -137,17 +365,230 @@ namespace xe
 			return m_callbacks.size();
 		}
 
+		// Call before subscribing many callbacks at once (ie. level loading) so Subscribe never reallocates
+		void Reserve(size_t count)
+		{
+			m_callbacks.reserve(count);
+			m_denseSlots.reserve(count);
+			m_slots.reserve(count);
+		}
+
+	protected:
+		// Subscribes with the callback placed at m_callbacks[index]. O(n), for ordered events.
+		FuncID InsertAt(size_t index, Callback&& callback)
+		{
+			const uint32_t slot = AcquireSlot();
+			m_denseSlots.pop_back();
+			m_callbacks.insert(m_callbacks.begin() + index, std::move(callback));
+			m_denseSlots.insert(m_denseSlots.begin() + index, slot);
+			UpdateDenseIndices(static_cast<uint32_t>(index));
+			return MakeID(slot, m_slots[slot].Generation);
+		}
+
+		bool IsParallelSafe(size_t index) const
+		{
+			return m_slots[m_denseSlots[index]].ParallelSafe;
+		}
+
+		// Serial callbacks run on the calling thread first, then the parallel-safe ones across the pool
+		template <typename... Args>
+		void DispatchParallel(ThreadPool& pool, const Args&... args) const
+		{
+			size_t parallelCount = 0;
+			for (size_t i = 0; i < m_callbacks.size(); ++i)
+			{
+				if (IsParallelSafe(i))
+					++parallelCount;
+				else
+					m_callbacks[i](args...);
+			}
+
+			if (parallelCount == 0)
+				return;
+
+			pool.ParallelFor(m_callbacks.size(), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					if (IsParallelSafe(i))
+						m_callbacks[i](args...);
+				}
+			});
+		}
+
+		std::vector<Callback> m_callbacks;
+
 	private:
-		FuncID NewID() const
+		static const uint32_t k_indexBits = 16;
+		static const uint32_t k_indexMask = (1u << k_indexBits) - 1;
+		static const uint32_t k_generationMask = (1u << (32 - k_indexBits)) - 1;
+		static const uint32_t k_noSlot = UINT32_MAX;
+
+		// DenseIndex points into m_callbacks while the slot is used, and to the next free slot when it is not
+		struct Slot
+		{
+			uint32_t DenseIndex;
+			uint16_t Generation;
+			bool ParallelSafe;
+		};
+
+		static FuncID MakeID(uint32_t slot, uint32_t generation) { return (generation << k_indexBits) | slot; }
+		static uint32_t SlotIndex(FuncID id) { return id & k_indexMask; }
+		static uint32_t Generation(FuncID id) { return id >> k_indexBits; }
+
+		// Also records the slot's dense index, the caller appends the callback
+		uint32_t AcquireSlot()
+		{
+			uint32_t slot;
+			if (m_freeSlot != k_noSlot)
+			{
+				slot = m_freeSlot;
+				m_freeSlot = m_slots[slot].DenseIndex;
+			}
+			else
+			{
+				if (m_slots.size() > k_indexMask)
+					throw std::length_error("[xe::Event] Too many subscribers");
+
+				// Generations start at 1 so no ID is ever k_invalidFuncID
+				slot = static_cast<uint32_t>(m_slots.size());
+				m_slots.push_back({ 0, 1, false });
+			}
+
+			m_slots[slot].DenseIndex = static_cast<uint32_t>(m_denseSlots.size());
+			m_slots[slot].ParallelSafe = false;
+			m_denseSlots.push_back(slot);
+			return slot;
+		}
+
+		void UpdateDenseIndices(uint32_t first)
 		{
-			std::random_device rd;
-			std::mt19937 gen(rd());
-			std::uniform_int_distribution<uint32_t> dis(0, UINT32_MAX);
-			return dis(gen);
+			for (uint32_t i = first; i < m_denseSlots.size(); ++i)
+				m_slots[m_denseSlots[i]].DenseIndex = i;
 		}
 
-		std::unordered_map<FuncID, std::function<void(Context)>> m_callbacks;
+		void ReleaseSlot(uint32_t slot)
+		{
+			// The generation wraps back to 1, skipping 0 so no ID is ever k_invalidFuncID
+			Slot& entry = m_slots[slot];
+			entry.Generation = (entry.Generation == k_generationMask) ? 1 : static_cast<uint16_t>(entry.Generation + 1);
+			entry.DenseIndex = m_freeSlot;
+			m_freeSlot = slot;
+		}
+
+		std::vector<uint32_t> m_denseSlots;
+		std::vector<Slot> m_slots;
+		uint32_t m_freeSlot = k_noSlot;
+	};
+
+	// Callback signature for a given Context: Result(Context), or Result() for Context = void
+	template <typename Context, typename Result = void>
+	struct EventSignature
+	{
+		using Type = Result(Context);
+	};
+
+	template <typename Result>
+	struct EventSignature<void, Result>
+	{
+		using Type = Result();
 	};
+
+	template <typename Context = void, typename Callback = std::function<typename EventSignature<Context>::Type>>
+	class Event : public EventBase<Callback>
+	{
+	public:
+		void Invoke(const Context& ctx) const
+		{
+			for (size_t i = 0; i < this->m_callbacks.size(); ++i)
+			{
+				this->m_callbacks[i](ctx);
+			}
+		}
+
+		// Blocks until every callback has run. ctx is shared by all threads.
+		void InvokeParallel(const Context& ctx, ThreadPool& pool = ThreadPool::Default()) const
+		{
+			this->DispatchParallel(pool, ctx);
+		}
+	};
+
+	template <typename Callback>
+	class Event<void, Callback> : public EventBase<Callback>
+	{
+	public:
+		void Invoke() const
+		{
+			for (size_t i = 0; i < this->m_callbacks.size(); ++i)
+			{
+				this->m_callbacks[i]();
+			}
+		}
+
+		// Blocks until every callback has run
+		void InvokeParallel(ThreadPool& pool = ThreadPool::Default()) const
+		{
+			this->DispatchParallel(pool);
+		}
+	};
+
+	template <typename Callback>
+	struct PriorityEventEntry
+	{
+		int Priority;
+		Callback Func;
+	};
+
+	// Callbacks return true when they handled the event, which stops the dispatch.
+	// Higher priorities run first, equal priorities in subscription order. Sorted on Subscribe.
+	template <typename Context = void, typename Callback = std::function<typename EventSignature<Context, bool>::Type>>
+	class PriorityEvent : public EventBase<PriorityEventEntry<Callback>, true>
+	{
+	public:
+		FuncID Subscribe(Callback callback, int priority = 0)
+		{
+			auto position = std::upper_bound(this->m_callbacks.begin(), this->m_callbacks.end(), priority,
+				[](int value, const PriorityEventEntry<Callback>& entry) { return value > entry.Priority; });
+			return this->InsertAt(position - this->m_callbacks.begin(), { priority, std::move(callback) });
+		}
+
+		// Returns true if a callback handled the event
+		bool Invoke(const Context& ctx) const
+		{
+			for (size_t i = 0; i < this->m_callbacks.size(); ++i)
+			{
+				if (this->m_callbacks[i].Func(ctx))
+					return true;
+			}
+			return false;
+		}
+	};
+
+	template <typename Callback>
+	class PriorityEvent<void, Callback> : public EventBase<PriorityEventEntry<Callback>, true>
+	{
+	public:
+		FuncID Subscribe(Callback callback, int priority = 0)
+		{
+			auto position = std::upper_bound(this->m_callbacks.begin(), this->m_callbacks.end(), priority,
+				[](int value, const PriorityEventEntry<Callback>& entry) { return value > entry.Priority; });
+			return this->InsertAt(position - this->m_callbacks.begin(), { priority, std::move(callback) });
+		}
+
+		// Returns true if a callback handled the event
+		bool Invoke() const
+		{
+			for (size_t i = 0; i < this->m_callbacks.size(); ++i)
+			{
+				if (this->m_callbacks[i].Func())
+					return true;
+			}
+			return false;
+		}
+	};
+
+	template <typename Context = void, size_t BufferSize = XE_DELEGATE_BUFFER_SIZE>
+	using DelegateEvent = Event<Context, Delegate<typename EventSignature<Context>::Type, BufferSize>>;
 }
 
 #endif //!XE_EVENT_H
\ No newline at end of file
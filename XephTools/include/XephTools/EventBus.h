@@ -0,0 +1,156 @@
+/*========================================================
+
+ XephTools - Event Bus
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - The payload types are listed once, in the EventBus type. Each one gets a channel (an xe::Event
+	plus a queue) stored in a std::tuple, and the channel for a type is found with std::get at
+	compile time. Using a type that is not in the list is a compile error.
+  - Publish calls the subscribers right away. Post queues the payload until Dispatch.
+  - Payloads posted while Dispatch is running (ie. from a subscriber) go into the next one.
+	Dispatch called from a subscriber skips the channels already being dispatched for the same reason.
+	If a subscriber throws, the rest of that channel's batch is dropped.
+  - Not thread safe. Use xe::EventQueue when producers run on other threads.
+
+========================================================*/
+
+#ifndef XE_EVENTBUS_H
+#define XE_EVENTBUS_H
+
+#include "Event.h"
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xe
+{
+	template <typename Payload, typename... Payloads>
+	inline constexpr bool k_containsPayload = (std::is_same_v<Payload, Payloads> || ...);
+
+	template <typename... Payloads>
+	class EventBus
+	{
+	public:
+		// Shared bus for this set of payload types. ie. using GameBus = xe::EventBus<Hit, Spawn>; GameBus::Get()
+		static EventBus& Get()
+		{
+			static EventBus instance;
+			return instance;
+		}
+
+		template <typename Payload>
+		Event<Payload>& Channel()
+		{
+			return GetChannel<Payload>().Subscribers;
+		}
+
+		template <typename Payload, typename Func>
+		FuncID Subscribe(Func&& callback)
+		{
+			return GetChannel<Payload>().Subscribers.Subscribe(std::forward<Func>(callback));
+		}
+
+		template <typename Payload>
+		bool Unsubscribe(const FuncID id)
+		{
+			return GetChannel<Payload>().Subscribers.Unsubscribe(id);
+		}
+
+		// Calls every subscriber of this payload type now
+		template <typename Payload>
+		void Publish(const Payload& payload) const
+		{
+			GetChannel<Payload>().Subscribers.Invoke(payload);
+		}
+
+		// Queues the payload until the next Dispatch
+		template <typename Payload>
+		void Post(Payload&& payload)
+		{
+			GetChannel<std::decay_t<Payload>>().Queued.push_back(std::forward<Payload>(payload));
+		}
+
+		// Publishes everything posted, channel by channel in the order of Payloads
+		void Dispatch()
+		{
+			(DispatchChannel<Payloads>(), ...);
+		}
+
+	private:
+		static_assert(sizeof...(Payloads) > 0, "EventBus needs at least one payload type");
+
+		template <typename Payload>
+		struct ChannelData
+		{
+			Event<Payload> Subscribers;
+			std::vector<Payload> Queued;
+			std::vector<Payload> Dispatching;
+			bool IsDispatching = false;
+		};
+
+		template <typename Payload>
+		ChannelData<Payload>& GetChannel()
+		{
+			static_assert(k_containsPayload<Payload, Payloads...>, "Payload type is not part of this EventBus");
+			return std::get<ChannelData<Payload>>(m_channels);
+		}
+
+		template <typename Payload>
+		const ChannelData<Payload>& GetChannel() const
+		{
+			static_assert(k_containsPayload<Payload, Payloads...>, "Payload type is not part of this EventBus");
+			return std::get<ChannelData<Payload>>(m_channels);
+		}
+
+		// Payloads posted by subscribers during Dispatch wait for the next one, and a channel that is
+		// already dispatching is skipped by a nested Dispatch. If a subscriber throws, the rest of the batch is dropped.
+		template <typename Payload>
+		void DispatchChannel()
+		{
+			ChannelData<Payload>& channel = GetChannel<Payload>();
+			if (channel.IsDispatching || channel.Queued.empty())
+				return;
+
+			channel.Dispatching.swap(channel.Queued);
+
+			struct EndDispatch
+			{
+				ChannelData<Payload>& Channel;
+
+				~EndDispatch()
+				{
+					Channel.Dispatching.clear();
+					Channel.IsDispatching = false;
+				}
+			} endDispatch{ channel };
+			channel.IsDispatching = true;
+
+			for (const Payload& payload : channel.Dispatching)
+				channel.Subscribers.Invoke(payload);
+		}
+
+		std::tuple<ChannelData<Payloads>...> m_channels;
+	};
+}
+
+#endif // !XE_EVENTBUS_H
@@ -0,0 +1,237 @@
+/*========================================================
+
+ XephTools - Event Queue
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Enqueue only appends the payload to a contiguous buffer. Dispatch hands every subscriber
+	the whole batch as one std::span, then clears the buffer (keeping its capacity).
+  - Enqueue is thread safe. Subscribe, Unsubscribe and Dispatch are not, and belong on the thread
+	that owns the sync point.
+  - Payloads enqueued while Dispatch is running (ie. from a callback) go into the next batch.
+	Dispatch called from a callback of the same event is ignored for the same reason.
+  - EventQueue holds one QueuedEvent per payload type, up to XE_EVENTQUEUE_MAX_TYPES types.
+
+========================================================*/
+
+#ifndef XE_EVENTQUEUE_H
+#define XE_EVENTQUEUE_H
+
+#include "Event.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifndef XE_EVENTQUEUE_MAX_TYPES
+#define XE_EVENTQUEUE_MAX_TYPES 64
+#endif // XE_EVENTQUEUE_MAX_TYPES
+
+namespace xe
+{
+	class QueuedEventBase
+	{
+	public:
+		virtual ~QueuedEventBase() = default;
+		virtual void Dispatch() = 0;
+	};
+
+	template <typename Context, typename Callback = std::function<void(std::span<const Context>)>>
+	class QueuedEvent : public QueuedEventBase, public EventBase<Callback>
+	{
+	public:
+		void Enqueue(const Context& payload)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(payload);
+		}
+
+		void Enqueue(Context&& payload)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(std::move(payload));
+		}
+
+		// One lock for the whole range. Prefer this when a producer has many payloads.
+		void EnqueueBatch(std::span<const Context> payloads)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.insert(m_pending.end(), payloads.begin(), payloads.end());
+		}
+
+		template <typename... Args>
+		void Emplace(Args&&... args)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.emplace_back(std::forward<Args>(args)...);
+		}
+
+		// Calls every subscriber once with everything enqueued since the last Dispatch.
+		// A Dispatch from inside a callback does nothing; its payloads go out with the next one.
+		// If a callback throws, the rest of the batch's subscribers are skipped and the batch is dropped.
+		void Dispatch() override
+		{
+			if (m_dispatching)
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_pending.empty())
+					return;
+				m_batch.swap(m_pending);
+			}
+
+			struct EndDispatch
+			{
+				QueuedEvent& Owner;
+
+				~EndDispatch()
+				{
+					Owner.m_batch.clear();
+					Owner.m_dispatching = false;
+				}
+			} endDispatch{ *this };
+			m_dispatching = true;
+
+			const std::span<const Context> batch(m_batch);
+			for (size_t i = 0; i < this->m_callbacks.size(); ++i)
+			{
+				this->m_callbacks[i](batch);
+			}
+		}
+
+		size_t Pending() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_pending.size();
+		}
+
+		// Call once up front so a frame's worth of payloads never reallocates
+		void ReservePayloads(size_t count)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.reserve(count);
+			m_batch.reserve(count);
+		}
+
+	private:
+		mutable std::mutex m_mutex;
+		std::vector<Context> m_pending;
+		std::vector<Context> m_batch;
+		bool m_dispatching = false;
+	};
+
+	// One QueuedEvent per payload type, all dispatched together at a sync point
+	class EventQueue
+	{
+	public:
+		EventQueue() = default;
+		EventQueue(const EventQueue&) = delete;
+		EventQueue& operator=(const EventQueue&) = delete;
+
+		~EventQueue()
+		{
+			for (std::atomic<QueuedEventBase*>& slot : m_events)
+				delete slot.load(std::memory_order_relaxed);
+		}
+
+		template <typename Context>
+		QueuedEvent<Context>& Get()
+		{
+			const uint32_t type = TypeIndex<Context>();
+			QueuedEventBase* queued = m_events[type].load(std::memory_order_acquire);
+			if (!queued)
+				queued = Create<Context>(type);
+			return *static_cast<QueuedEvent<Context>*>(queued);
+		}
+
+		template <typename Context, typename Func>
+		FuncID Subscribe(Func&& callback)
+		{
+			return Get<Context>().Subscribe(std::forward<Func>(callback));
+		}
+
+		template <typename Context>
+		bool Unsubscribe(const FuncID id)
+		{
+			return Get<Context>().Unsubscribe(id);
+		}
+
+		template <typename Context>
+		void Enqueue(Context&& payload)
+		{
+			Get<std::decay_t<Context>>().Enqueue(std::forward<Context>(payload));
+		}
+
+		template <typename Context>
+		void EnqueueBatch(std::span<const Context> payloads)
+		{
+			Get<Context>().EnqueueBatch(payloads);
+		}
+
+		// Dispatches every payload type, in the order the types were first used
+		void Dispatch()
+		{
+			const uint32_t count = m_order.load(std::memory_order_acquire);
+			for (uint32_t i = 0; i < count; ++i)
+				m_events[m_dispatchOrder[i]].load(std::memory_order_acquire)->Dispatch();
+		}
+
+	private:
+		template <typename Context>
+		static uint32_t TypeIndex()
+		{
+			static const uint32_t index = s_nextType.fetch_add(1, std::memory_order_relaxed);
+			if (index >= XE_EVENTQUEUE_MAX_TYPES)
+				throw std::length_error("[xe::EventQueue] Too many payload types. Increase XE_EVENTQUEUE_MAX_TYPES");
+			return index;
+		}
+
+		template <typename Context>
+		QueuedEventBase* Create(uint32_t type)
+		{
+			std::lock_guard<std::mutex> lock(m_createMutex);
+			QueuedEventBase* queued = m_events[type].load(std::memory_order_relaxed);
+			if (queued)
+				return queued;
+
+			queued = new QueuedEvent<Context>();
+			m_events[type].store(queued, std::memory_order_release);
+			const uint32_t order = m_order.load(std::memory_order_relaxed);
+			m_dispatchOrder[order] = type;
+			m_order.store(order + 1, std::memory_order_release);
+			return queued;
+		}
+
+		static inline std::atomic<uint32_t> s_nextType = 0;
+
+		std::atomic<QueuedEventBase*> m_events[XE_EVENTQUEUE_MAX_TYPES] = {};
+		uint32_t m_dispatchOrder[XE_EVENTQUEUE_MAX_TYPES] = {};
+		std::atomic<uint32_t> m_order = 0;
+		std::mutex m_createMutex;
+	};
+}
+
+#endif // !XE_EVENTQUEUE_H
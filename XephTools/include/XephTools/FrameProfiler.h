@@ -0,0 +1,392 @@
+/*========================================================
+
+ XephTools - Frame Profiler
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Only scopes on the thread that calls BeginFrame/EndFrame, between those calls, are recorded.
+	Scopes on any other thread return before touching the profiler state.
+  - Nodes are identified by (parent, name), so the same scope reached through different
+	callers shows up once under each caller.
+  - All memory is allocated in the constructor: XE_FRAMEPROFILER_FRAMES rows of
+	XE_FRAMEPROFILER_MAX_NODES times and call counts. Scopes past the node or depth limits are ignored.
+
+========================================================*/
+
+#ifndef XE_FRAMEPROFILER_H
+#define XE_FRAMEPROFILER_H
+
+#include "Timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Rolling window size, in frames
+#ifndef XE_FRAMEPROFILER_FRAMES
+#define XE_FRAMEPROFILER_FRAMES 120
+#endif // XE_FRAMEPROFILER_FRAMES
+
+#ifndef XE_FRAMEPROFILER_MAX_NODES
+#define XE_FRAMEPROFILER_MAX_NODES 256
+#endif // XE_FRAMEPROFILER_MAX_NODES
+
+#ifndef XE_FRAMEPROFILER_MAX_DEPTH
+#define XE_FRAMEPROFILER_MAX_DEPTH 32
+#endif // XE_FRAMEPROFILER_MAX_DEPTH
+
+namespace xe
+{
+	// Per node timings over the frames in the window. Frames the node did not run in count as 0.
+	struct FrameProfileStats
+	{
+		float MinMs = 0.f;
+		float AvgMs = 0.f;
+		float MaxMs = 0.f;
+		float AvgCalls = 0.f;
+	};
+
+	class FrameProfiler
+	{
+	private:
+		static_assert(XE_FRAMEPROFILER_MAX_NODES < UINT16_MAX, "Node indices are 16-bit");
+
+	public:
+		static const uint16_t k_none = UINT16_MAX;
+		static const uint16_t k_root = 0;
+
+		FrameProfiler()
+			: m_times(std::make_unique<int64_t[]>(XE_FRAMEPROFILER_FRAMES * XE_FRAMEPROFILER_MAX_NODES))
+			, m_calls(std::make_unique<uint32_t[]>(XE_FRAMEPROFILER_FRAMES * XE_FRAMEPROFILER_MAX_NODES))
+		{
+			m_nodes[k_root] = { "Frame", k_none, k_none, k_none, 0 };
+			m_nodeCount = 1;
+		}
+
+		FrameProfiler(const FrameProfiler& other) = delete;
+		FrameProfiler& operator=(const FrameProfiler& other) = delete;
+
+		void BeginFrame()
+		{
+			if (m_inFrame)
+				EndFrame();
+
+			m_frameThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+			m_row = static_cast<size_t>(m_frameCount % XE_FRAMEPROFILER_FRAMES);
+			std::fill_n(Times(m_row), m_nodeCount, 0);
+			std::fill_n(Calls(m_row), m_nodeCount, 0);
+
+			m_inFrame = true;
+			m_depth = 0;
+			m_ignoredDepth = 0;
+			Push(k_root);
+		}
+
+		// Closes any scope left open, then the frame itself
+		void EndFrame()
+		{
+			if (!m_inFrame)
+				return;
+
+			m_ignoredDepth = 0;
+			while (m_depth > 0)
+				Pop();
+
+			m_inFrame = false;
+			++m_frameCount;
+
+			if (m_reportStream && m_reportTimer.GetElapsed() >= m_reportInterval)
+			{
+				m_reportTimer.Reset();
+				WriteReport(*m_reportStream);
+			}
+		}
+
+		// `name` must outlive the profiler (ie. a string literal)
+		void BeginScope(const char* name)
+		{
+			if (!IsFrameThread() || !m_inFrame)
+				return;
+
+			if (m_ignoredDepth > 0 || m_depth >= XE_FRAMEPROFILER_MAX_DEPTH)
+			{
+				++m_ignoredDepth;
+				return;
+			}
+
+			const uint16_t node = FindOrAddChild(m_stack[m_depth - 1], name);
+			if (node == k_none)
+			{
+				++m_ignoredDepth;
+				return;
+			}
+			Push(node);
+		}
+
+		void EndScope()
+		{
+			if (!IsFrameThread() || !m_inFrame)
+				return;
+
+			if (m_ignoredDepth > 0)
+			{
+				--m_ignoredDepth;
+				return;
+			}
+
+			// The root is only closed by EndFrame
+			if (m_depth > 1)
+				Pop();
+		}
+
+		// Number of completed frames in the window
+		size_t FrameCount() const
+		{
+			return static_cast<size_t>(std::min<uint64_t>(m_frameCount, XE_FRAMEPROFILER_FRAMES));
+		}
+
+		size_t NodeCount() const { return m_nodeCount; }
+		const char* NodeName(uint16_t node) const { return m_nodes[node].Name; }
+		uint16_t NodeDepth(uint16_t node) const { return m_nodes[node].Depth; }
+		uint16_t NodeParent(uint16_t node) const { return m_nodes[node].Parent; }
+
+		FrameProfileStats GetStats(uint16_t node) const
+		{
+			FrameProfileStats stats;
+			const size_t frames = FrameCount();
+			if (frames == 0 || node >= m_nodeCount)
+				return stats;
+
+			int64_t min = INT64_MAX, max = 0, total = 0;
+			uint64_t calls = 0;
+			for (size_t i = 0; i < frames; ++i)
+			{
+				const size_t row = CompletedRow(i);
+				const int64_t time = Times(row)[node];
+				min = std::min(min, time);
+				max = std::max(max, time);
+				total += time;
+				calls += Calls(row)[node];
+			}
+
+			stats.MinMs = static_cast<float>(min * 1e-6);
+			stats.MaxMs = static_cast<float>(max * 1e-6);
+			stats.AvgMs = static_cast<float>(static_cast<double>(total) / frames * 1e-6);
+			stats.AvgCalls = static_cast<float>(static_cast<double>(calls) / frames);
+			return stats;
+		}
+
+		// Visits every node depth first (children in first-seen order): func(uint16_t node, const FrameProfileStats& stats)
+		template <typename Func>
+		void Visit(Func&& func) const
+		{
+			uint16_t node = k_root;
+			while (node != k_none)
+			{
+				func(node, GetStats(node));
+
+				if (m_nodes[node].FirstChild != k_none)
+				{
+					node = m_nodes[node].FirstChild;
+					continue;
+				}
+				while (node != k_none && m_nodes[node].NextSibling == k_none)
+					node = m_nodes[node].Parent;
+				if (node != k_none)
+					node = m_nodes[node].NextSibling;
+			}
+		}
+
+		// Indented tree of avg/min/max per node over the window
+		void WriteReport(std::ostream& stream) const
+		{
+			const std::ios::fmtflags flags = stream.flags();
+			const std::streamsize precision = stream.precision();
+			const float frameMs = GetStats(k_root).AvgMs;
+
+			stream << "[xe::FrameProfiler] last " << FrameCount() << " frames\n";
+			stream << std::left << std::setw(40) << "Scope" << std::right << std::setw(10) << "Avg ms" << std::setw(10) << "Min ms"
+				<< std::setw(10) << "Max ms" << std::setw(8) << "%" << std::setw(8) << "Calls" << "\n";
+			stream << std::fixed << std::setprecision(3);
+			Visit([&](uint16_t node, const FrameProfileStats& stats)
+				{
+					std::string name = std::string(m_nodes[node].Depth * 2, ' ') + m_nodes[node].Name;
+					if (name.length() > 39)
+						name = name.substr(0, 36) + "...";
+
+					stream << std::left << std::setw(40) << name << std::right << std::setw(10) << stats.AvgMs
+						<< std::setw(10) << stats.MinMs << std::setw(10) << stats.MaxMs
+						<< std::setw(8) << std::setprecision(1) << ((frameMs > 0.f) ? stats.AvgMs / frameMs * 100.f : 0.f)
+						<< std::setw(8) << stats.AvgCalls << std::setprecision(3) << "\n";
+				});
+			stream.flags(flags);
+			stream.precision(precision);
+			stream.flush();
+		}
+
+		// Writes the report from EndFrame every `intervalSeconds`. nullptr disables.
+		void SetReportStream(std::ostream* stream, float intervalSeconds = 5.f)
+		{
+			m_reportStream = stream;
+			m_reportInterval = intervalSeconds;
+			m_reportTimer.Reset();
+		}
+
+		// Forgets every node and frame, ie. after a level change
+		void Reset()
+		{
+			m_inFrame = false;
+			m_frameCount = 0;
+			m_nodeCount = 1;
+			m_nodes[k_root].FirstChild = k_none;
+		}
+
+		static FrameProfiler& Get()
+		{
+			static FrameProfiler instance;
+			return instance;
+		}
+
+	private:
+		struct Node
+		{
+			const char* Name;
+			uint16_t Parent;
+			uint16_t FirstChild;
+			uint16_t NextSibling;
+			uint16_t Depth;
+		};
+
+		int64_t* Times(size_t row) { return m_times.get() + row * XE_FRAMEPROFILER_MAX_NODES; }
+		const int64_t* Times(size_t row) const { return m_times.get() + row * XE_FRAMEPROFILER_MAX_NODES; }
+		uint32_t* Calls(size_t row) { return m_calls.get() + row * XE_FRAMEPROFILER_MAX_NODES; }
+		const uint32_t* Calls(size_t row) const { return m_calls.get() + row * XE_FRAMEPROFILER_MAX_NODES; }
+
+		// index 0 is the most recent completed frame
+		size_t CompletedRow(size_t index) const
+		{
+			return static_cast<size_t>((m_frameCount - 1 - index) % XE_FRAMEPROFILER_FRAMES);
+		}
+
+		bool IsFrameThread() const
+		{
+			return m_frameThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+		}
+
+		uint16_t FindOrAddChild(uint16_t parent, const char* name)
+		{
+			uint16_t last = k_none;
+			for (uint16_t child = m_nodes[parent].FirstChild; child != k_none; child = m_nodes[child].NextSibling)
+			{
+				if (m_nodes[child].Name == name || std::strcmp(m_nodes[child].Name, name) == 0)
+					return child;
+				last = child;
+			}
+
+			if (m_nodeCount >= XE_FRAMEPROFILER_MAX_NODES)
+				return k_none;
+
+			const uint16_t node = static_cast<uint16_t>(m_nodeCount++);
+			m_nodes[node] = { name, parent, k_none, k_none, static_cast<uint16_t>(m_nodes[parent].Depth + 1) };
+			if (last == k_none)
+				m_nodes[parent].FirstChild = node;
+			else
+				m_nodes[last].NextSibling = node;
+
+			// The node has no history yet: clear its column so older frames read as 0
+			for (size_t row = 0; row < XE_FRAMEPROFILER_FRAMES; ++row)
+			{
+				Times(row)[node] = 0;
+				Calls(row)[node] = 0;
+			}
+			return node;
+		}
+
+		void Push(uint16_t node)
+		{
+			m_stack[m_depth] = node;
+			m_start[m_depth] = m_timer.GetElapsedNanoseconds();
+			++m_depth;
+		}
+
+		void Pop()
+		{
+			--m_depth;
+			const uint16_t node = m_stack[m_depth];
+			Times(m_row)[node] += m_timer.GetElapsedNanoseconds() - m_start[m_depth];
+			++Calls(m_row)[node];
+		}
+
+		Timer m_timer;
+		std::unique_ptr<int64_t[]> m_times;
+		std::unique_ptr<uint32_t[]> m_calls;
+		Node m_nodes[XE_FRAMEPROFILER_MAX_NODES];
+		size_t m_nodeCount = 0;
+
+		uint16_t m_stack[XE_FRAMEPROFILER_MAX_DEPTH];
+		int64_t m_start[XE_FRAMEPROFILER_MAX_DEPTH];
+		size_t m_depth = 0;
+		size_t m_ignoredDepth = 0;
+
+		uint64_t m_frameCount = 0;
+		size_t m_row = 0;
+		bool m_inFrame = false;
+		std::atomic<std::thread::id> m_frameThread; // Set by BeginFrame. Scopes on other threads stop at this check.
+
+		std::ostream* m_reportStream = nullptr;
+		float m_reportInterval = 5.f;
+		Timer m_reportTimer;
+	};
+
+	class FrameProfileScope
+	{
+	public:
+		FrameProfileScope(const char* name, FrameProfiler& profiler = FrameProfiler::Get())
+			: m_profiler(profiler)
+		{
+			m_profiler.BeginScope(name);
+		}
+
+		~FrameProfileScope()
+		{
+			m_profiler.EndScope();
+		}
+
+		FrameProfileScope(const FrameProfileScope& other) = delete;
+		FrameProfileScope& operator=(const FrameProfileScope& other) = delete;
+
+	private:
+		FrameProfiler& m_profiler;
+	};
+}
+
+#define XE_FRAMEPROFILER_CONCAT_IMPL(a, b) a##b
+#define XE_FRAMEPROFILER_CONCAT(a, b) XE_FRAMEPROFILER_CONCAT_IMPL(a, b)
+
+#define XEFrameProfileScope(name) xe::FrameProfileScope XE_FRAMEPROFILER_CONCAT(xeFrameProfileScope, __LINE__)(name)
+#define XEFrameProfileFunction XEFrameProfileScope(__func__)
+
+#endif // !XE_FRAMEPROFILER_H
@@ -27,6 +27,8 @@
 #ifndef XE_MATH_H
 #define XE_MATH_H
 #include <iostream>
+#include <cmath>
+#include <cfloat>
 #include <vector>
 #include <assert.h>
 
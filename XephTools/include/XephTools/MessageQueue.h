@@ -0,0 +1,330 @@
+/*========================================================
+
+ XephTools - Message Queue
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Bounded, lock-free ring queues. Capacity must be a power of 2 and the storage is allocated
+	once in the constructor. Push returns false instead of blocking when the queue is full.
+  - SpscQueue: one producer thread, one consumer thread. Producer and consumer each cache the
+	other side's index, so they only touch the shared cache line when the cache runs out.
+  - MpscQueue: any number of producer threads, one consumer thread. Each cell carries a sequence
+	number (Vyukov's bounded queue), so producers only contend on one atomic increment.
+  - T must be default constructible and move assignable. Pop moves the item out, leaving a moved-from
+	T in the cell; PopBatch hands func a reference to the item in its cell instead.
+  - DrainInto(queue, event) pops everything currently queued and calls event.Invoke for each item.
+
+========================================================*/
+
+#ifndef XE_MESSAGEQUEUE_H
+#define XE_MESSAGEQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+
+namespace xe
+{
+	template <typename T, size_t Capacity>
+	class SpscQueue
+	{
+	private:
+		static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "SpscQueue Capacity must be a power of 2");
+		static const size_t k_mask = Capacity - 1;
+
+	public:
+		SpscQueue()
+			: m_items(std::make_unique<T[]>(Capacity))
+		{
+		}
+
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		// Producer thread only
+		template <typename U>
+		bool Push(U&& item)
+		{
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			if (head - m_producerTail > k_mask)
+			{
+				m_producerTail = m_tail.load(std::memory_order_acquire);
+				if (head - m_producerTail > k_mask)
+					return false;
+			}
+
+			m_items[head & k_mask] = std::forward<U>(item);
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Producer thread only. Pushes as many as fit and returns how many that was.
+		size_t PushBatch(std::span<const T> items)
+		{
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			size_t space = Capacity - (head - m_producerTail);
+			if (space < items.size())
+			{
+				m_producerTail = m_tail.load(std::memory_order_acquire);
+				space = Capacity - (head - m_producerTail);
+			}
+
+			const size_t count = (items.size() < space) ? items.size() : space;
+			for (size_t i = 0; i < count; ++i)
+				m_items[(head + i) & k_mask] = items[i];
+			m_head.store(head + count, std::memory_order_release);
+			return count;
+		}
+
+		// Consumer thread only
+		bool Pop(T& item)
+		{
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail == m_consumerHead)
+			{
+				m_consumerHead = m_head.load(std::memory_order_acquire);
+				if (tail == m_consumerHead)
+					return false;
+			}
+
+			item = std::move(m_items[tail & k_mask]);
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer thread only. Calls func(item) for each queued item, up to maxCount, then frees their cells
+		// with one store. The item func throws from counts as consumed, so an item is never delivered twice.
+		template <typename Func>
+		size_t PopBatch(Func&& func, size_t maxCount = SIZE_MAX)
+		{
+			struct Release
+			{
+				std::atomic<size_t>& Tail;
+				const size_t Start;
+				size_t Count;
+
+				~Release()
+				{
+					if (Count > 0)
+						Tail.store(Start + Count, std::memory_order_release);
+				}
+			};
+
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			m_consumerHead = m_head.load(std::memory_order_acquire);
+			const size_t pending = m_consumerHead - tail;
+			const size_t count = (pending < maxCount) ? pending : maxCount;
+
+			Release release{ m_tail, tail, 0 };
+			while (release.Count < count)
+			{
+				T& item = m_items[(tail + release.Count) & k_mask];
+				++release.Count;
+				func(item);
+			}
+			return count;
+		}
+
+		// Approximate when called while the other thread is working
+		size_t Size() const
+		{
+			return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+		}
+
+		static constexpr size_t GetCapacity() { return Capacity; }
+
+	private:
+		alignas(64) std::atomic<size_t> m_head = 0;
+		size_t m_producerTail = 0;
+		alignas(64) std::atomic<size_t> m_tail = 0;
+		size_t m_consumerHead = 0;
+		alignas(64) std::unique_ptr<T[]> m_items;
+	};
+
+	template <typename T, size_t Capacity>
+	class MpscQueue
+	{
+	private:
+		static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "MpscQueue Capacity must be a power of 2");
+		static const size_t k_mask = Capacity - 1;
+
+		// Sequence == index: free for the producer claiming index. Sequence == index + 1: holds an item.
+		struct Cell
+		{
+			std::atomic<size_t> Sequence;
+			T Item;
+		};
+
+	public:
+		MpscQueue()
+			: m_cells(std::make_unique<Cell[]>(Capacity))
+		{
+			for (size_t i = 0; i < Capacity; ++i)
+				m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		// Any thread
+		template <typename U>
+		bool Push(U&& item)
+		{
+			size_t head = m_head.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell& cell = m_cells[head & k_mask];
+				const size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+				const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head);
+				if (difference == 0)
+				{
+					if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+					{
+						cell.Item = std::forward<U>(item);
+						cell.Sequence.store(head + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false; // Full
+				}
+				else
+				{
+					head = m_head.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Any thread. Claims a run of cells with one increment and returns how many items were pushed.
+		size_t PushBatch(std::span<const T> items)
+		{
+			size_t head = m_head.load(std::memory_order_relaxed);
+			size_t count;
+			while (true)
+			{
+				// Only claim cells that are already free, so the whole run can be written without waiting
+				count = 0;
+				while (count < items.size()
+					&& m_cells[(head + count) & k_mask].Sequence.load(std::memory_order_acquire) == head + count)
+				{
+					++count;
+				}
+				if (count == 0)
+				{
+					const size_t current = m_head.load(std::memory_order_relaxed);
+					if (current == head)
+						return 0; // Full
+					head = current;
+					continue;
+				}
+				if (m_head.compare_exchange_weak(head, head + count, std::memory_order_relaxed))
+					break;
+			}
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				Cell& cell = m_cells[(head + i) & k_mask];
+				cell.Item = items[i];
+				cell.Sequence.store(head + i + 1, std::memory_order_release);
+			}
+			return count;
+		}
+
+		// Consumer thread only. Returns false when empty, or when the next producer has not finished writing.
+		bool Pop(T& item)
+		{
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			Cell& cell = m_cells[tail & k_mask];
+			if (cell.Sequence.load(std::memory_order_acquire) != tail + 1)
+				return false;
+
+			item = std::move(cell.Item);
+			cell.Sequence.store(tail + Capacity, std::memory_order_release);
+			m_tail.store(tail + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// Consumer thread only. Calls func(item) for each ready item, up to maxCount.
+		// Each cell is released as its item is handled, even if func throws, so an item is never delivered twice.
+		template <typename Func>
+		size_t PopBatch(Func&& func, size_t maxCount = SIZE_MAX)
+		{
+			struct Release
+			{
+				MpscQueue& Queue;
+				Cell& Consumed;
+				size_t Tail;
+
+				~Release()
+				{
+					Consumed.Sequence.store(Tail + Capacity, std::memory_order_release);
+					Queue.m_tail.store(Tail + 1, std::memory_order_relaxed);
+				}
+			};
+
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			size_t count = 0;
+			while (count < maxCount)
+			{
+				Cell& cell = m_cells[tail & k_mask];
+				if (cell.Sequence.load(std::memory_order_acquire) != tail + 1)
+					break;
+
+				Release release{ *this, cell, tail };
+				func(cell.Item);
+				++tail;
+				++count;
+			}
+			return count;
+		}
+
+		// Approximate when called while producers are working
+		size_t Size() const
+		{
+			return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+		}
+
+		static constexpr size_t GetCapacity() { return Capacity; }
+
+	private:
+		alignas(64) std::atomic<size_t> m_head = 0;
+		alignas(64) std::atomic<size_t> m_tail = 0;
+		alignas(64) std::unique_ptr<Cell[]> m_cells;
+	};
+
+	// Consumer side: invokes `event` once per queued item, in one pass. Returns the number of items.
+	template <typename T, size_t Capacity, typename Event>
+	size_t DrainInto(SpscQueue<T, Capacity>& queue, const Event& event, size_t maxCount = SIZE_MAX)
+	{
+		return queue.PopBatch([&event](T& item) { event.Invoke(item); }, maxCount);
+	}
+
+	template <typename T, size_t Capacity, typename Event>
+	size_t DrainInto(MpscQueue<T, Capacity>& queue, const Event& event, size_t maxCount = SIZE_MAX)
+	{
+		return queue.PopBatch([&event](T& item) { event.Invoke(item); }, maxCount);
+	}
+}
+
+#endif // !XE_MESSAGEQUEUE_H
@@ -0,0 +1,451 @@
+/*========================================================
+
+ XephTools - Micro Benchmark
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Each benchmark body runs its timed loop as `for (auto _ : state) { ... }`. Setup before the
+	loop is not timed.
+  - The iteration count is scaled until one sample takes at least MinSampleSeconds, then
+	Samples samples are taken. Statistics are nanoseconds per iteration across samples.
+  - Command line (XEMicroBenchmarkMain): --filter=<text> --samples=<n> --min-time=<seconds>
+	--warmup=<seconds> --csv=<file> --json=<file>
+
+========================================================*/
+
+#ifndef XE_MICROBENCHMARK_H
+#define XE_MICROBENCHMARK_H
+
+#include "Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif // _MSC_VER
+
+namespace xe
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	inline const volatile void* volatile g_microBenchmarkSink = nullptr;
+
+	// Forces `value` to be computed (and stored) without the compiler knowing how it is used
+	template <typename T>
+	inline void DoNotOptimize(const T& value)
+	{
+		g_microBenchmarkSink = &value;
+		_ReadWriteBarrier();
+	}
+
+	// Forces pending writes to memory to happen before this point
+	inline void ClobberMemory()
+	{
+		_ReadWriteBarrier();
+	}
+#else
+	template <typename T>
+	inline void DoNotOptimize(const T& value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	template <typename T>
+	inline void DoNotOptimize(T& value)
+	{
+		asm volatile("" : "+m"(value) : : "memory");
+	}
+
+	inline void ClobberMemory()
+	{
+		asm volatile("" : : : "memory");
+	}
+#endif // _MSC_VER
+
+	class MicroBenchmarkState
+	{
+	public:
+		MicroBenchmarkState(uint64_t iterations) : m_iterations(iterations) {}
+
+		class Iterator
+		{
+		public:
+			Iterator(MicroBenchmarkState* state, uint64_t remaining) : m_state(state), m_remaining(remaining) {}
+
+			struct [[maybe_unused]] Value {};
+
+			Value operator*() const { return Value(); }
+			void operator++() { --m_remaining; }
+
+			// The loop condition also stops the timer, so nothing after the last iteration is measured
+			bool operator!=(const Iterator&) const
+			{
+				if (m_remaining != 0)
+					return true;
+
+				m_state->Finish();
+				return false;
+			}
+
+		private:
+			MicroBenchmarkState* m_state;
+			uint64_t m_remaining;
+		};
+
+		Iterator begin()
+		{
+			m_timer.Reset();
+			return Iterator(this, m_iterations);
+		}
+
+		Iterator end()
+		{
+			return Iterator(this, 0);
+		}
+
+		uint64_t Iterations() const { return m_iterations; }
+		int64_t ElapsedNanoseconds() const { return m_elapsed; }
+		bool IsFinished() const { return m_isFinished; } // False if the body never ran its loop to the end
+
+		// Adds a throughput (MiB/s) column to the results
+		void SetBytesPerIteration(uint64_t bytes) { m_bytesPerIteration = bytes; }
+		uint64_t BytesPerIteration() const { return m_bytesPerIteration; }
+
+	private:
+		void Finish()
+		{
+			m_elapsed = m_timer.GetElapsedNanoseconds();
+			m_isFinished = true;
+		}
+
+		Timer m_timer;
+		uint64_t m_iterations;
+		uint64_t m_bytesPerIteration = 0;
+		int64_t m_elapsed = 0;
+		bool m_isFinished = false;
+	};
+
+	struct MicroBenchmarkSettings
+	{
+		double WarmupSeconds = 0.1;
+		double MinSampleSeconds = 0.01;
+		size_t Samples = 20;
+		std::string Filter; // Only run benchmarks whose name contains this
+	};
+
+	// All times are nanoseconds per iteration
+	struct MicroBenchmarkResult
+	{
+		std::string Name;
+		uint64_t Iterations = 0; // Per sample
+		size_t Samples = 0;
+		double Mean = 0.0;
+		double StdDev = 0.0;
+		double Median = 0.0;
+		double Min = 0.0;
+		double Max = 0.0;
+		uint64_t BytesPerIteration = 0;
+
+		double MiBPerSecond() const
+		{
+			return (Mean > 0.0) ? static_cast<double>(BytesPerIteration) / Mean * 1e9 / (1024.0 * 1024.0) : 0.0;
+		}
+	};
+
+	class MicroBenchmarkRunner
+	{
+	public:
+		using Function = void(*)(MicroBenchmarkState&);
+
+		// Called from the XEMicroBenchmark static initializer
+		bool Register(const char* name, Function function)
+		{
+			m_benchmarks.push_back({ name, function });
+			return true;
+		}
+
+		std::vector<MicroBenchmarkResult> Run(const MicroBenchmarkSettings& settings, std::ostream* log = &std::cout)
+		{
+			std::vector<MicroBenchmarkResult> results;
+			for (const Entry& entry : m_benchmarks)
+			{
+				if (!settings.Filter.empty() && entry.Name.find(settings.Filter) == std::string::npos)
+					continue;
+
+				results.push_back(Run(entry.Name, entry.Callback, settings));
+				if (log)
+				{
+					if (results.size() == 1)
+						WriteHeader(*log);
+					WriteRow(*log, results.back());
+				}
+			}
+			return results;
+		}
+
+		static MicroBenchmarkResult Run(const std::string& name, Function function, const MicroBenchmarkSettings& settings)
+		{
+			const int64_t minSampleNs = static_cast<int64_t>(settings.MinSampleSeconds * 1e9);
+			const int64_t warmupNs = static_cast<int64_t>(settings.WarmupSeconds * 1e9);
+
+			// Warmup doubles as calibration: grow the iteration count until one sample is long enough
+			uint64_t iterations = 1;
+			uint64_t bytesPerIteration = 0;
+			Timer warmup;
+			while (true)
+			{
+				MicroBenchmarkState state(iterations);
+				function(state);
+				bytesPerIteration = state.BytesPerIteration();
+
+				// Elapsed would stay 0 and the iteration count would grow forever
+				if (!state.IsFinished())
+					throw std::logic_error("[xe::MicroBenchmark] " + name + " did not run its `for (auto _ : state)` loop");
+
+				const int64_t elapsed = state.ElapsedNanoseconds();
+				if (elapsed >= minSampleNs && warmup.GetElapsedNanoseconds() >= warmupNs)
+					break;
+				if (elapsed >= minSampleNs)
+					continue;
+
+				const double scale = (elapsed > 0) ? static_cast<double>(minSampleNs) * 1.4 / static_cast<double>(elapsed) : 100.0;
+				iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::clamp(scale, 2.0, 100.0));
+			}
+
+			std::vector<double> samples;
+			samples.reserve(settings.Samples);
+			for (size_t i = 0; i < std::max<size_t>(settings.Samples, 1); ++i)
+			{
+				MicroBenchmarkState state(iterations);
+				function(state);
+				samples.push_back(static_cast<double>(state.ElapsedNanoseconds()) / static_cast<double>(iterations));
+			}
+
+			MicroBenchmarkResult result;
+			result.Name = name;
+			result.Iterations = iterations;
+			result.Samples = samples.size();
+			result.BytesPerIteration = bytesPerIteration;
+
+			for (double sample : samples)
+				result.Mean += sample;
+			result.Mean /= static_cast<double>(samples.size());
+
+			for (double sample : samples)
+				result.StdDev += (sample - result.Mean) * (sample - result.Mean);
+			result.StdDev = (samples.size() > 1) ? std::sqrt(result.StdDev / static_cast<double>(samples.size() - 1)) : 0.0;
+
+			std::sort(samples.begin(), samples.end());
+			const size_t middle = samples.size() / 2;
+			result.Median = (samples.size() % 2 == 0) ? (samples[middle - 1] + samples[middle]) / 2.0 : samples[middle];
+			result.Min = samples.front();
+			result.Max = samples.back();
+			return result;
+		}
+
+		static void WriteTable(std::ostream& stream, const std::vector<MicroBenchmarkResult>& results)
+		{
+			WriteHeader(stream);
+			for (const MicroBenchmarkResult& result : results)
+				WriteRow(stream, result);
+		}
+
+		static void WriteCsv(std::ostream& stream, const std::vector<MicroBenchmarkResult>& results)
+		{
+			stream << "name,iterations,samples,mean_ns,stddev_ns,median_ns,min_ns,max_ns,mib_per_s\n";
+			for (const MicroBenchmarkResult& result : results)
+			{
+				stream << '"' << Escape(result.Name) << "\"," << result.Iterations << ',' << result.Samples << ','
+					<< result.Mean << ',' << result.StdDev << ',' << result.Median << ',' << result.Min << ',' << result.Max << ','
+					<< result.MiBPerSecond() << '\n';
+			}
+		}
+
+		static void WriteJson(std::ostream& stream, const std::vector<MicroBenchmarkResult>& results)
+		{
+			stream << "{\"benchmarks\":[";
+			for (size_t i = 0; i < results.size(); ++i)
+			{
+				const MicroBenchmarkResult& result = results[i];
+				if (i > 0)
+					stream << ',';
+				stream << "{\"name\":\"" << Escape(result.Name) << "\",\"iterations\":" << result.Iterations << ",\"samples\":" << result.Samples
+					<< ",\"mean_ns\":" << result.Mean << ",\"stddev_ns\":" << result.StdDev << ",\"median_ns\":" << result.Median
+					<< ",\"min_ns\":" << result.Min << ",\"max_ns\":" << result.Max << ",\"mib_per_s\":" << result.MiBPerSecond() << '}';
+			}
+			stream << "]}\n";
+		}
+
+		static void WriteUsage(std::ostream& stream)
+		{
+			stream << "Usage: --filter=<text> --samples=<n> --min-time=<seconds> --warmup=<seconds> --csv=<file> --json=<file>" << std::endl;
+		}
+
+		// Entry point used by XEMicroBenchmarkMain. Returns non-zero on bad arguments, if a benchmark does not run
+		// its loop, or if an export file can't be written.
+		int Main(int argc, char** argv)
+		{
+			MicroBenchmarkSettings settings;
+			std::string csvPath, jsonPath;
+			for (int i = 1; i < argc; ++i)
+			{
+				const std::string arg = argv[i];
+				const size_t split = arg.find('=');
+				const std::string key = arg.substr(0, split);
+				const std::string value = (split == std::string::npos) ? "" : arg.substr(split + 1);
+
+				try
+				{
+					if (key == "--filter")
+						settings.Filter = value;
+					else if (key == "--samples")
+						settings.Samples = std::stoul(value);
+					else if (key == "--min-time")
+						settings.MinSampleSeconds = std::stod(value);
+					else if (key == "--warmup")
+						settings.WarmupSeconds = std::stod(value);
+					else if (key == "--csv")
+						csvPath = value;
+					else if (key == "--json")
+						jsonPath = value;
+					else
+					{
+						std::cout << "[xe::MicroBenchmark] Unknown argument: " << arg << std::endl;
+						WriteUsage(std::cout);
+						return 1;
+					}
+				}
+				catch (const std::exception&) // std::invalid_argument or std::out_of_range from stoul/stod
+				{
+					std::cout << "[xe::MicroBenchmark] Invalid value: " << arg << std::endl;
+					WriteUsage(std::cout);
+					return 1;
+				}
+			}
+
+			std::vector<MicroBenchmarkResult> results;
+			try
+			{
+				results = Run(settings);
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << e.what() << std::endl;
+				return 1;
+			}
+			if (!csvPath.empty() && !WriteFile(csvPath, results, &MicroBenchmarkRunner::WriteCsv))
+				return 1;
+			if (!jsonPath.empty() && !WriteFile(jsonPath, results, &MicroBenchmarkRunner::WriteJson))
+				return 1;
+			return 0;
+		}
+
+		static MicroBenchmarkRunner& Get()
+		{
+			static MicroBenchmarkRunner instance;
+			return instance;
+		}
+
+	private:
+		struct Entry
+		{
+			std::string Name;
+			Function Callback;
+		};
+
+		static void WriteHeader(std::ostream& stream)
+		{
+			const std::ios::fmtflags flags = stream.flags();
+			stream << std::left << std::setw(40) << "Benchmark" << std::right
+				<< std::setw(12) << "Iterations" << std::setw(12) << "Mean ns" << std::setw(12) << "StdDev ns"
+				<< std::setw(12) << "Median ns" << std::setw(12) << "Min ns" << std::setw(12) << "Max ns" << std::setw(12) << "MiB/s" << "\n";
+			stream.flags(flags);
+		}
+
+		static void WriteRow(std::ostream& stream, const MicroBenchmarkResult& result)
+		{
+			const std::ios::fmtflags flags = stream.flags();
+			const std::streamsize precision = stream.precision();
+			std::string name = result.Name;
+			if (name.length() > 39)
+				name = name.substr(0, 36) + "...";
+
+			stream << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(12) << result.Iterations << std::setw(12) << result.Mean << std::setw(12) << result.StdDev
+				<< std::setw(12) << result.Median << std::setw(12) << result.Min << std::setw(12) << result.Max;
+			if (result.BytesPerIteration > 0)
+				stream << std::setw(12) << result.MiBPerSecond();
+			stream << std::endl;
+			stream.flags(flags);
+			stream.precision(precision);
+		}
+
+		static bool WriteFile(const std::string& path, const std::vector<MicroBenchmarkResult>& results,
+			void(*writer)(std::ostream&, const std::vector<MicroBenchmarkResult>&))
+		{
+			std::ofstream file(path);
+			if (!file.is_open())
+			{
+				std::cout << "[xe::MicroBenchmark] Could not open " << path << std::endl;
+				return false;
+			}
+			writer(file, results);
+			return true;
+		}
+
+		static std::string Escape(const std::string& str)
+		{
+			std::string result;
+			for (const char c : str)
+			{
+				if (c == '"' || c == '\\')
+					result.push_back('\\');
+				result.push_back(c);
+			}
+			return result;
+		}
+
+		std::vector<Entry> m_benchmarks;
+	};
+}
+
+#define XE_MICROBENCHMARK_CONCAT_IMPL(a, b) a##b
+#define XE_MICROBENCHMARK_CONCAT(a, b) XE_MICROBENCHMARK_CONCAT_IMPL(a, b)
+
+// Usage: XEMicroBenchmark("Module/Name") { setup; for (auto _ : state) { timed code } }
+#define XEMicroBenchmark(name) \
+	static void XE_MICROBENCHMARK_CONCAT(xeMicroBenchmark, __LINE__)(xe::MicroBenchmarkState& state); \
+	static const bool XE_MICROBENCHMARK_CONCAT(xeMicroBenchmarkRegistered, __LINE__) = \
+		xe::MicroBenchmarkRunner::Get().Register(name, &XE_MICROBENCHMARK_CONCAT(xeMicroBenchmark, __LINE__)); \
+	static void XE_MICROBENCHMARK_CONCAT(xeMicroBenchmark, __LINE__)(xe::MicroBenchmarkState& state)
+
+// Defines main() running every registered benchmark. Place in one .cpp file.
+#define XEMicroBenchmarkMain \
+	int main(int argc, char** argv) { return xe::MicroBenchmarkRunner::Get().Main(argc, argv); }
+
+#endif // !XE_MICROBENCHMARK_H
@@ -0,0 +1,266 @@
+/*========================================================
+
+ XephTools - Thread Pool
+ Copyright (C) 2024 Jon Bogert (jonbogert@gmail.com)
+
+ This software is provided 'as-is', without any express or implied warranty.
+ In no event will the authors be held liable for any damages arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it freely,
+ subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented;
+	you must not claim that you wrote the original software.
+	If you use this software in a product, an acknowledgment
+	in the product documentation would be appreciated but is not required.
+
+ 2. Altered source versions must be plainly marked as such,
+	and must not be misrepresented as being the original software.
+
+ 3. This notice may not be removed or altered from any source distribution.
+
+ Note:
+  - Work stealing: every worker has its own deque. A worker splits the range it is given in half,
+	pushes the upper half onto its own deque and keeps the lower half, until the range is no
+	larger than the grain size. Idle workers steal the oldest (largest) range from the others.
+  - ParallelFor blocks, and the calling thread runs ranges too, so it can be called from inside
+	a task without deadlocking. Tasks are plain structs; nothing is allocated per call.
+  - The first exception thrown by `func` is rethrown from ParallelFor once every range has run.
+
+========================================================*/
+
+#ifndef XE_THREADPOOL_H
+#define XE_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace xe
+{
+	class ThreadPool
+	{
+	public:
+		// threadCount = 0 runs everything on the calling thread
+		explicit ThreadPool(size_t threadCount = DefaultThreadCount())
+			: m_queues(threadCount + 1)
+		{
+			m_threads.reserve(threadCount);
+			for (size_t i = 0; i < threadCount; ++i)
+				m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (std::thread& thread : m_threads)
+				thread.join();
+		}
+
+		// Shared pool with one thread per core, minus the calling thread
+		static ThreadPool& Default()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		static size_t DefaultThreadCount()
+		{
+			const size_t cores = std::thread::hardware_concurrency();
+			return (cores > 1) ? cores - 1 : 0;
+		}
+
+		size_t ThreadCount() const
+		{
+			return m_threads.size();
+		}
+
+		// Calls func(begin, end) over [0, count) in ranges of at most `grain` and waits for all of them.
+		// grain = 0 picks about four ranges per thread.
+		template <typename Func>
+		void ParallelFor(size_t count, size_t grain, Func&& func)
+		{
+			if (count == 0)
+				return;
+			if (grain == 0)
+				grain = std::max<size_t>(1, count / ((m_threads.size() + 1) * 4));
+			if (m_threads.empty() || count <= grain)
+			{
+				func(size_t(0), count);
+				return;
+			}
+
+			Job job;
+			job.Run = [](void* data, size_t begin, size_t end) { (*static_cast<std::remove_reference_t<Func>*>(data))(begin, end); };
+			job.Data = const_cast<void*>(static_cast<const void*>(std::addressof(func)));
+			job.Grain = grain;
+			job.Remaining.store(count, std::memory_order_relaxed);
+
+			const size_t self = QueueIndex();
+			Execute({ &job, 0, count }, self);
+			while (job.Remaining.load(std::memory_order_acquire) != 0)
+			{
+				if (!TryRunOne(self))
+					std::this_thread::yield();
+			}
+
+			if (job.Error)
+				std::rethrow_exception(job.Error);
+		}
+
+	private:
+		struct Job
+		{
+			void (*Run)(void* data, size_t begin, size_t end);
+			void* Data;
+			size_t Grain;
+			std::atomic<size_t> Remaining;
+			std::atomic<bool> Failed = false;
+			std::exception_ptr Error;
+		};
+
+		struct Task
+		{
+			Job* Owner;
+			size_t Begin;
+			size_t End;
+		};
+
+		struct alignas(64) Queue
+		{
+			std::mutex Mutex;
+			std::deque<Task> Tasks;
+		};
+
+		// Workers use their own queue. Any other thread shares the last one.
+		size_t QueueIndex() const
+		{
+			return (t_pool == this) ? t_worker : m_queues.size() - 1;
+		}
+
+		void Push(const Task& task, size_t queue)
+		{
+			// Counted before it is visible, so m_queued never underflows when the task is stolen straight away
+			m_queued.fetch_add(1, std::memory_order_seq_cst);
+			{
+				std::lock_guard<std::mutex> lock(m_queues[queue].Mutex);
+				m_queues[queue].Tasks.push_back(task);
+			}
+			if (m_sleeping.load(std::memory_order_seq_cst) > 0)
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+				m_wake.notify_one();
+			}
+		}
+
+		// Own queue newest first (still hot in cache), then steal the oldest from the others
+		bool TryPop(size_t self, Task& task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_queues[self].Mutex);
+				if (!m_queues[self].Tasks.empty())
+				{
+					task = m_queues[self].Tasks.back();
+					m_queues[self].Tasks.pop_back();
+					m_queued.fetch_sub(1, std::memory_order_relaxed);
+					return true;
+				}
+			}
+
+			for (size_t i = 1; i < m_queues.size(); ++i)
+			{
+				Queue& victim = m_queues[(self + i) % m_queues.size()];
+				std::lock_guard<std::mutex> lock(victim.Mutex);
+				if (!victim.Tasks.empty())
+				{
+					task = victim.Tasks.front();
+					victim.Tasks.pop_front();
+					m_queued.fetch_sub(1, std::memory_order_relaxed);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool TryRunOne(size_t self)
+		{
+			Task task;
+			if (!TryPop(self, task))
+				return false;
+			Execute(task, self);
+			return true;
+		}
+
+		void Execute(Task task, size_t self)
+		{
+			Job& job = *task.Owner;
+			while (task.End - task.Begin > job.Grain)
+			{
+				const size_t middle = task.Begin + (task.End - task.Begin) / 2;
+				Push({ &job, middle, task.End }, self);
+				task.End = middle;
+			}
+
+			if (!job.Failed.load(std::memory_order_relaxed))
+			{
+				try
+				{
+					job.Run(job.Data, task.Begin, task.End);
+				}
+				catch (...)
+				{
+					if (!job.Failed.exchange(true))
+						job.Error = std::current_exception();
+				}
+			}
+			job.Remaining.fetch_sub(task.End - task.Begin, std::memory_order_acq_rel);
+		}
+
+		void WorkerLoop(size_t index)
+		{
+			t_pool = this;
+			t_worker = index;
+			while (true)
+			{
+				if (TryRunOne(index))
+					continue;
+
+				std::unique_lock<std::mutex> lock(m_sleepMutex);
+				m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+				m_wake.wait(lock, [this]() { return m_stop || m_queued.load(std::memory_order_seq_cst) > 0; });
+				m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+				if (m_stop)
+					return;
+			}
+		}
+
+		static inline thread_local const ThreadPool* t_pool = nullptr;
+		static inline thread_local size_t t_worker = 0;
+
+		std::vector<Queue> m_queues;
+		std::vector<std::thread> m_threads;
+		std::atomic<size_t> m_queued = 0;
+		std::atomic<size_t> m_sleeping = 0;
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wake;
+		bool m_stop = false;
+	};
+}
+
+#endif // !XE_THREADPOOL_H
@@ -25,36 +25,45 @@
 #ifndef XE_TIMER_H
 #define XE_TIMER_H
 
-#include <chrono>
+#include "Clock.h"
+
+#include <cstdint>
+#include <iostream>
 
 namespace xe
 {
-	class Timer
+	// Clock is a policy from Clock.h (xe::SteadyClock, xe::TscClock, ...)
+	template <typename Clock = DefaultClock>
+	class BasicTimer
 	{
-		std::chrono::high_resolution_clock::time_point _startPoint;
+		int64_t _startPoint;
 
 	public:
-		Timer()
+		BasicTimer()
 		{
 			Reset();
 		}
 
 		void Reset()
 		{
-			_startPoint = std::chrono::high_resolution_clock::now();
+			_startPoint = Clock::Now();
+		}
+
+		int64_t GetElapsedNanoseconds() const
+		{
+			return Clock::Now() - _startPoint;
 		}
 
 		float GetElapsed()
 		{
-			std::chrono::microseconds delta;
-			delta = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - _startPoint);
-			return std::chrono::duration<float>(delta).count();
+			return static_cast<float>(static_cast<double>(GetElapsedNanoseconds()) * 1e-9);
 		}
 
 		float DeltaTime()
 		{
-			float deltaTime = GetElapsed();
-			Reset();
+			const int64_t now = Clock::Now();
+			const float deltaTime = static_cast<float>(static_cast<double>(now - _startPoint) * 1e-9);
+			_startPoint = now;
 			return deltaTime;
 		}
 
@@ -66,8 +75,11 @@ namespace xe
 			else
 			{
 				std::cout << "[xe::Timer] Tried to divide by zero. Returning 0.f" << std::endl;
+				return 0.f;
 			}
 		}
 	};
+
+	using Timer = BasicTimer<>;
 }
 #endif // XE_TIMER_H
\ No newline at end of file